@@ -0,0 +1,100 @@
+#include "devices/clock.h"
+#include <debug.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include "devices/timer.h"
+#include "threads/interrupt.h"
+#include "threads/synch.h"
+
+/* High-resolution monotonic clock.
+
+   The CPU's time-stamp counter (TSC) increments at a constant
+   rate, so after measuring that rate against the timer we can
+   convert TSC readings to nanoseconds without any I/O, much more
+   cheaply and precisely than by reading the PIT.
+
+   Converting a 64-bit cycle count to nanoseconds with a 64-bit
+   division on every call would be slow, so clock_calibrate()
+   precomputes the number of nanoseconds per cycle as a 32.32
+   fixed-point number, split into integer and fraction parts so
+   that no intermediate product overflows 64 bits. */
+
+static uint64_t tsc_hz;         /* TSC cycles per second, 0 if unknown. */
+static uint64_t tsc_base;       /* TSC at which clock_ns() returns 0. */
+static uint32_t ns_int;         /* Integer part of ns per cycle. */
+static uint32_t ns_frac;        /* Fraction of ns per cycle, times 2**32. */
+
+/* Sets up clock_ns(), measuring the rate of the TSC against one
+   timer tick unless it was given on the kernel command line.
+   The clock starts at the current value of timer_ticks(), so
+   that the two agree.  The timer must be running. */
+void
+clock_calibrate (void) 
+{
+  uint64_t per_cycle;
+  enum intr_level old_level;
+
+  if (tsc_hz == 0)
+    tsc_hz = timer_measure_tsc ();
+  ASSERT (tsc_hz > 0);
+  per_cycle = ((uint64_t) NSEC_PER_SEC << 32) / tsc_hz;
+  ns_int = per_cycle >> 32;
+  ns_frac = per_cycle;
+
+  old_level = intr_disable ();
+  tsc_base = clock_rdtsc () - timer_ticks () * (tsc_hz / TIMER_FREQ);
+  intr_set_level (old_level);
+
+  printf ("TSC runs at %'"PRIu64" Hz (-tsc=%"PRIu64").\n",
+          tsc_hz, (tsc_hz + 500) / 1000);
+}
+
+/* Sets the rate of the TSC to KHZ kHz, so that clock_calibrate()
+   does not need to measure it.  For use by the "-tsc" kernel
+   command-line option, with a value printed by an earlier
+   boot. */
+void
+clock_set_tsc_khz (unsigned khz) 
+{
+  tsc_hz = (uint64_t) khz * 1000;
+}
+
+/* Returns true if clock_calibrate() has been called. */
+bool
+clock_calibrated (void) 
+{
+  return ns_int != 0 || ns_frac != 0;
+}
+
+/* Returns the number of nanoseconds since the OS booted.  Before
+   clock_calibrate() has run, the result has only timer tick
+   resolution. */
+uint64_t
+clock_ns (void) 
+{
+  if (!clock_calibrated ())
+    return timer_ticks () * (NSEC_PER_SEC / TIMER_FREQ);
+
+  return clock_cycles_to_ns (clock_rdtsc () - tsc_base);
+}
+
+/* Converts CYCLES, a difference between two TSC readings, to
+   nanoseconds.  clock_calibrate() must have been called. */
+uint64_t
+clock_cycles_to_ns (uint64_t cycles) 
+{
+  uint32_t hi = cycles >> 32;
+  uint32_t lo = cycles;
+
+  return (cycles * ns_int
+          + (uint64_t) hi * ns_frac
+          + (((uint64_t) lo * ns_frac) >> 32));
+}
+
+/* Returns the TSC rate in cycles per second, or 0 if
+   clock_calibrate() has not been called. */
+uint64_t
+clock_tsc_hz (void) 
+{
+  return tsc_hz;
+}
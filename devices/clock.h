@@ -0,0 +1,27 @@
+#ifndef DEVICES_CLOCK_H
+#define DEVICES_CLOCK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Nanoseconds per second. */
+#define NSEC_PER_SEC 1000000000
+
+void clock_calibrate (void);
+void clock_set_tsc_khz (unsigned);
+bool clock_calibrated (void);
+uint64_t clock_ns (void);
+uint64_t clock_cycles_to_ns (uint64_t cycles);
+uint64_t clock_tsc_hz (void);
+
+/* Returns the CPU's time-stamp counter, which counts CPU clock
+   cycles since reset. */
+static inline uint64_t
+clock_rdtsc (void)
+{
+  uint64_t tsc;
+  asm volatile ("rdtsc" : "=A" (tsc));
+  return tsc;
+}
+
+#endif /* devices/clock.h */
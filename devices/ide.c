@@ -6,6 +6,7 @@
 #include "devices/block.h"
 #include "devices/partition.h"
 #include "devices/timer.h"
+#include "threads/init.h"
 #include "threads/io.h"
 #include "threads/interrupt.h"
 #include "threads/synch.h"
@@ -123,9 +124,9 @@ ide_init (void)
         default:
           NOT_REACHED ();
         }
-      lock_init (&c->lock);
+      lock_init_named (&c->lock, "ide channel", chan_no);
       c->expecting_interrupt = false;
-      sema_init (&c->completion_wait, 0);
+      sema_init_named (&c->completion_wait, 0, "ide completion", chan_no);
  
       /* Initialize devices. */
       for (dev_no = 0; dev_no < 2; dev_no++)
@@ -147,6 +148,7 @@ ide_init (void)
       /* Distinguish ATA hard disks from other devices. */
       if (check_device_type (&c->devices[0]))
         check_device_type (&c->devices[1]);
+      boot_phase ("ide probe");
 
       /* Read hard disk identity information. */
       for (dev_no = 0; dev_no < 2; dev_no++)
@@ -306,7 +308,9 @@ identify_ata_device (struct ata_disk *d)
   /* Register. */
   block = block_register (d->name, BLOCK_RAW, extra_info, capacity,
                           &ide_operations, d);
+  boot_phase ("ide identify");
   partition_scan (block);
+  boot_phase ("partition_scan");
 }
 
 /* Translates STRING, which consists of SIZE bytes in a funky
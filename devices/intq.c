@@ -1,5 +1,6 @@
 #include "devices/intq.h"
 #include <debug.h>
+#include "threads/synch.h"
 #include "threads/thread.h"
 
 static int next (int pos);
@@ -92,7 +93,9 @@ wait (struct intq *q UNUSED, struct thread **waiter)
           || (waiter == &q->not_full && intq_full (q)));
 
   *waiter = thread_current ();
+  spinlock_acquire (&sched_lock);
   thread_block ();
+  spinlock_release (&sched_lock);
 }
 
 /* WAITER must be the address of Q's not_empty or not_full
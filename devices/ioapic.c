@@ -0,0 +1,95 @@
+#include "devices/ioapic.h"
+#include <debug.h>
+#include "threads/interrupt.h"
+
+/* Interface to the I/O APIC, which routes interrupts from
+   devices to the CPUs' local APICs, in place of the 8259A PICs.
+   Refer to [82093AA] for details. */
+
+/* I/O APIC registers, selected through IOREGSEL and accessed
+   through IOWIN. */
+#define IOAPIC_VER      0x01            /* Version. */
+#define IOAPIC_REDTBL   0x10            /* Redirection table. */
+
+/* Bits in redirection table entries. */
+#define REDTBL_ACTIVE_LOW 0x00002000    /* Polarity: active low. */
+#define REDTBL_LEVEL      0x00008000    /* Trigger mode: level. */
+#define REDTBL_MASKED     0x00010000    /* Interrupt masked. */
+
+/* Memory-mapped register window, mapped by cpu_init(). */
+struct ioapic_regs 
+  {
+    uint32_t regsel;            /* IOREGSEL: register to access. */
+    uint32_t pad[3];
+    uint32_t win;               /* IOWIN: selected register's value. */
+  };
+
+static volatile struct ioapic_regs *ioapic;
+
+/* Number of interrupt input pins. */
+static int pin_cnt;
+
+static uint32_t ioapic_read (int reg);
+static void ioapic_write (int reg, uint32_t value);
+
+/* Initializes the I/O APIC whose registers are mapped at REGS
+   and masks all its interrupts.  Interrupts must be off. */
+void
+ioapic_init (volatile void *regs) 
+{
+  int pin;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  ioapic = regs;
+  pin_cnt = ((ioapic_read (IOAPIC_VER) >> 16) & 0xff) + 1;
+  for (pin = 0; pin < pin_cnt; pin++) 
+    {
+      ioapic_write (IOAPIC_REDTBL + 2 * pin, REDTBL_MASKED);
+      ioapic_write (IOAPIC_REDTBL + 2 * pin + 1, 0);
+    }
+}
+
+/* Returns the number of interrupt input pins. */
+int
+ioapic_pin_cnt (void) 
+{
+  return pin_cnt;
+}
+
+/* Routes interrupt input PIN to interrupt vector VEC on the CPU
+   whose local APIC ID is APIC_ID, and unmasks it.  ACTIVE_LOW
+   and LEVEL_TRIGGERED describe the input signal.  Interrupts
+   must be off. */
+void
+ioapic_route (int pin, uint8_t vec, uint8_t apic_id,
+              bool active_low, bool level_triggered) 
+{
+  uint32_t low = vec;
+
+  ASSERT (pin >= 0 && pin < pin_cnt);
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (active_low)
+    low |= REDTBL_ACTIVE_LOW;
+  if (level_triggered)
+    low |= REDTBL_LEVEL;
+  ioapic_write (IOAPIC_REDTBL + 2 * pin + 1, (uint32_t) apic_id << 24);
+  ioapic_write (IOAPIC_REDTBL + 2 * pin, low);
+}
+
+/* Returns the value of I/O APIC register REG. */
+static uint32_t
+ioapic_read (int reg) 
+{
+  ioapic->regsel = reg;
+  return ioapic->win;
+}
+
+/* Writes VALUE to I/O APIC register REG. */
+static void
+ioapic_write (int reg, uint32_t value) 
+{
+  ioapic->regsel = reg;
+  ioapic->win = value;
+}
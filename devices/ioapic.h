@@ -0,0 +1,12 @@
+#ifndef DEVICES_IOAPIC_H
+#define DEVICES_IOAPIC_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+void ioapic_init (volatile void *regs);
+int ioapic_pin_cnt (void);
+void ioapic_route (int pin, uint8_t vec, uint8_t apic_id,
+                   bool active_low, bool level_triggered);
+
+#endif /* devices/ioapic.h */
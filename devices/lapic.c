@@ -0,0 +1,165 @@
+#include "devices/lapic.h"
+#include <debug.h>
+#include "devices/timer.h"
+#include "threads/interrupt.h"
+
+/* Interface to the local APIC, the interrupt controller built
+   into each CPU, which receives interrupts from the I/O APIC
+   and from the other CPUs.  Each CPU sees its own local APIC's
+   registers at the same physical address.  Refer to [IA32-v3a]
+   chapter 8 "Advanced Programmable Interrupt Controller (APIC)"
+   for details. */
+
+/* Local APIC registers, as byte offsets. */
+#define LAPIC_ID        0x020   /* Local APIC ID. */
+#define LAPIC_VER       0x030   /* Version. */
+#define LAPIC_TPR       0x080   /* Task priority. */
+#define LAPIC_EOI       0x0b0   /* End of interrupt. */
+#define LAPIC_SVR       0x0f0   /* Spurious interrupt vector. */
+#define LAPIC_ESR       0x280   /* Error status. */
+#define LAPIC_ICR_LOW   0x300   /* Interrupt command, bits 0...31. */
+#define LAPIC_ICR_HIGH  0x310   /* Interrupt command, bits 32...63. */
+#define LAPIC_TIMER     0x320   /* Local vector table: timer. */
+#define LAPIC_PERF      0x340   /* Local vector table: perf counters. */
+#define LAPIC_LINT0     0x350   /* Local vector table: LINT0 pin. */
+#define LAPIC_LINT1     0x360   /* Local vector table: LINT1 pin. */
+#define LAPIC_ERROR     0x370   /* Local vector table: errors. */
+
+/* Bits in LAPIC_SVR. */
+#define SVR_ENABLE      0x00000100      /* APIC software enable. */
+
+/* Bits in local vector table entries. */
+#define LVT_MASKED      0x00010000      /* Interrupt masked. */
+
+/* Bits in LAPIC_ICR_LOW. */
+#define ICR_FIXED       0x00000000      /* Fixed delivery of a vector. */
+#define ICR_INIT        0x00000500      /* INIT. */
+#define ICR_STARTUP     0x00000600      /* Startup IPI (SIPI). */
+#define ICR_PENDING     0x00001000      /* Delivery status: pending. */
+#define ICR_ASSERT      0x00004000      /* Level: assert. */
+#define ICR_LEVEL       0x00008000      /* Trigger mode: level. */
+
+/* Local APIC registers, mapped by cpu_init(). */
+static volatile uint32_t *lapic;
+
+static void send_icr (uint8_t apic_id, uint32_t icr);
+static uint32_t lapic_read (int reg);
+static void lapic_write (int reg, uint32_t value);
+
+/* Sets the virtual address at which the local APIC's registers
+   are mapped to REGS. */
+void
+lapic_set_regs (volatile void *regs) 
+{
+  lapic = regs;
+}
+
+/* Enables the current CPU's local APIC and masks all its local
+   interrupt sources, so that it delivers only interrupts from
+   the I/O APIC and from other CPUs.  Interrupts must be off. */
+void
+lapic_init (void) 
+{
+  int max_lvt;
+
+  ASSERT (lapic != NULL);
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  lapic_write (LAPIC_SVR, SVR_ENABLE | LAPIC_SPURIOUS_VEC);
+
+  lapic_write (LAPIC_TIMER, LVT_MASKED);
+  lapic_write (LAPIC_LINT0, LVT_MASKED);
+  lapic_write (LAPIC_LINT1, LVT_MASKED);
+  lapic_write (LAPIC_ERROR, LVT_MASKED);
+  max_lvt = (lapic_read (LAPIC_VER) >> 16) & 0xff;
+  if (max_lvt >= 4)
+    lapic_write (LAPIC_PERF, LVT_MASKED);
+
+  /* Clear errors, which takes back-to-back writes, and any
+     interrupt left in service, then accept all interrupts. */
+  lapic_write (LAPIC_ESR, 0);
+  lapic_write (LAPIC_ESR, 0);
+  lapic_write (LAPIC_EOI, 0);
+  lapic_write (LAPIC_TPR, 0);
+}
+
+/* Returns the current CPU's local APIC ID. */
+uint8_t
+lapic_id (void) 
+{
+  ASSERT (lapic != NULL);
+  return lapic_read (LAPIC_ID) >> 24;
+}
+
+/* Acknowledges the interrupt being handled. */
+void
+lapic_eoi (void) 
+{
+  lapic_write (LAPIC_EOI, 0);
+}
+
+/* Sends interrupt VEC to the CPU whose local APIC ID is
+   APIC_ID.  Interrupts must be off, so that nothing else uses
+   this CPU's interrupt command register meanwhile. */
+void
+lapic_send_ipi (uint8_t apic_id, uint8_t vec) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  send_icr (apic_id, ICR_FIXED | vec);
+}
+
+/* Sends the CPU whose local APIC ID is APIC_ID the INIT and
+   startup IPIs that make it start executing in real mode at
+   START_PADDR, which must be page-aligned and below 1 MB.  This
+   is the "universal startup algorithm" of [MP] appendix B.4.
+   Interrupts must be on, because the delays use the timer. */
+void
+lapic_start_ap (uint8_t apic_id, uintptr_t start_paddr) 
+{
+  enum intr_level old_level;
+  int i;
+
+  ASSERT (start_paddr % 4096 == 0 && start_paddr < 0x100000);
+  ASSERT (intr_get_level () == INTR_ON);
+
+  old_level = intr_disable ();
+  send_icr (apic_id, ICR_INIT | ICR_LEVEL | ICR_ASSERT);
+  send_icr (apic_id, ICR_INIT | ICR_LEVEL);
+  intr_set_level (old_level);
+  timer_mdelay (10);
+
+  for (i = 0; i < 2; i++) 
+    {
+      old_level = intr_disable ();
+      send_icr (apic_id, ICR_STARTUP | (start_paddr >> 12));
+      intr_set_level (old_level);
+      timer_udelay (200);
+    }
+}
+
+/* Writes ICR to the interrupt command register, addressed to
+   the CPU whose local APIC ID is APIC_ID, and waits for the
+   local APIC to accept it for delivery. */
+static void
+send_icr (uint8_t apic_id, uint32_t icr) 
+{
+  lapic_write (LAPIC_ICR_HIGH, (uint32_t) apic_id << 24);
+  lapic_write (LAPIC_ICR_LOW, icr);
+  while (lapic_read (LAPIC_ICR_LOW) & ICR_PENDING)
+    asm volatile ("pause");
+}
+
+/* Returns the value of local APIC register REG. */
+static uint32_t
+lapic_read (int reg) 
+{
+  return lapic[reg / sizeof *lapic];
+}
+
+/* Writes VALUE to local APIC register REG. */
+static void
+lapic_write (int reg, uint32_t value) 
+{
+  lapic[reg / sizeof *lapic] = value;
+}
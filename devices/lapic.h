@@ -0,0 +1,16 @@
+#ifndef DEVICES_LAPIC_H
+#define DEVICES_LAPIC_H
+
+#include <stdint.h>
+
+/* Interrupt vector for spurious local APIC interrupts. */
+#define LAPIC_SPURIOUS_VEC 0xff
+
+void lapic_set_regs (volatile void *regs);
+void lapic_init (void);
+uint8_t lapic_id (void);
+void lapic_eoi (void);
+void lapic_send_ipi (uint8_t apic_id, uint8_t vec);
+void lapic_start_ap (uint8_t apic_id, uintptr_t start_paddr);
+
+#endif /* devices/lapic.h */
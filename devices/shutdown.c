@@ -5,9 +5,12 @@
 #include "devices/serial.h"
 #include "devices/timer.h"
 #include "threads/io.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
 #include "threads/thread.h"
 #ifdef USERPROG
 #include "userprog/exception.h"
+#include "userprog/process.h"
 #endif
 #ifdef FILESYS
 #include "devices/block.h"
@@ -125,7 +128,13 @@ print_stats (void)
 #endif
   console_print_stats ();
   kbd_print_stats ();
+  malloc_print_stats ();
 #ifdef USERPROG
   exception_print_stats ();
+  process_print_stats ();
+#endif
+#ifdef LOCKSTAT
+  if (lockstat_top > 0)
+    lockstat_print (lockstat_top);
 #endif
 }
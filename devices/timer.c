@@ -3,7 +3,9 @@
 #include <inttypes.h>
 #include <round.h>
 #include <stdio.h>
+#include "devices/clock.h"
 #include "devices/pit.h"
+#include "threads/cpu.h"
 #include "threads/interrupt.h"
 #include "threads/synch.h"
 #include "threads/thread.h"
@@ -17,14 +19,87 @@
 #error TIMER_FREQ <= 1000 recommended
 #endif
 
-/* Number of timer ticks since OS booted. */
+/* Number of timer ticks since OS booted.  Written only with
+   interrupts off, inside ticks_seqlock, so that timer_ticks()
+   can read it without turning off interrupts. */
 static int64_t ticks;
+static struct seqlock ticks_seqlock;
 
 /* Number of loops per timer tick.
-   Initialized by timer_calibrate(). */
+   Initialized by timer_calibrate(), unless given on the kernel
+   command line with "-lpt=N". */
 static unsigned loops_per_tick;
 
+/* If false (default), the timer interrupts every tick.
+   If true, the timer stops ticking while the CPU is idle.
+   Controlled by kernel command-line option "-tickless". */
+bool timer_tickless;
+
+/* Number of PIT cycles per timer tick. */
+#define TICK_CYCLES ((PIT_HZ + TIMER_FREQ / 2) / TIMER_FREQ)
+
+/* Maximum number of ticks the PIT can count down at once. */
+#define TICKLESS_MAX_TICKS (UINT16_MAX / TICK_CYCLES)
+
+/* A one-shot count this close to expiring is left to expire,
+   to avoid racing with it when reprogramming the PIT. */
+#define TICKLESS_SLOP 64
+
+/* Tickless idle state.  While tickless_ticks is nonzero, the PIT
+   is programmed to interrupt once, tickless_ticks ticks after the
+   last tick counted in `ticks', instead of every tick.  The
+   one-shot count was started tickless_ofs PIT cycles after that
+   tick, with an initial value of tickless_count. */
+static int tickless_ticks;
+static unsigned tickless_ofs;
+static unsigned tickless_count;
+static int64_t tickless_skipped;  /* # of timer interrupts avoided. */
+
+/* List of threads blocked in timer_sleep(), in order of
+   increasing wake-up time.  Threads with equal wake-up times
+   are kept in the order in which they went to sleep. */
+static struct list sleep_list;
+
+/* Timer wheel, holding scheduled timer events.
+
+   The wheel has one level of WHEEL0_SIZE slots, one per tick,
+   for events due within WHEEL0_SIZE ticks, and WHEEL_LEVELS - 1
+   coarser levels of WHEELN_SIZE slots each, where each slot of
+   level L covers WHEEL0_SIZE * WHEELN_SIZE**L ticks.  Adding or
+   cancelling an event takes constant time, regardless of how
+   many events are scheduled.  Each time the finest level wraps
+   around, the next slot of the next coarser level is "cascaded":
+   its events are redistributed into finer slots.  Every event
+   in a level-0 slot is due at that slot's tick, so expiring
+   events never examines any that are not due.
+
+   wheel_time is the next tick whose level-0 slot has not yet
+   been processed.  It normally equals ticks + 1, but lags
+   behind after a tickless idle period; timer_tick() catches it
+   up. */
+#define WHEEL0_BITS 8
+#define WHEELN_BITS 6
+#define WHEEL_LEVELS 5
+#define WHEEL0_SIZE (1 << WHEEL0_BITS)
+#define WHEELN_SIZE (1 << WHEELN_BITS)
+#define WHEEL0_MASK (WHEEL0_SIZE - 1)
+#define WHEELN_MASK (WHEELN_SIZE - 1)
+#define WHEEL_MAX_DELTA (1LL << (WHEEL0_BITS + (WHEEL_LEVELS - 1) * WHEELN_BITS))
+
+static struct list wheel0[WHEEL0_SIZE];
+static struct list wheeln[WHEEL_LEVELS - 1][WHEELN_SIZE];
+static int64_t wheel_time;
+static int event_cnt;           /* Number of events in the wheel. */
+
 static intr_handler_func timer_interrupt;
+static void timer_tick (void);
+static list_less_func wakeup_less;
+static void wheel_add (struct timer_event *);
+static int wheel_cascade (int level, int index);
+static void wheel_run (void);
+static int64_t wheel_next_event (void);
+static unsigned calibrate_with_tsc (void);
+static unsigned calibrate_with_ticks (void);
 static bool too_many_loops (unsigned loops);
 static void busy_wait (int64_t loops);
 static void real_time_sleep (int64_t num, int32_t denom);
@@ -35,44 +110,96 @@ static void real_time_delay (int64_t num, int32_t denom);
 void
 timer_init (void) 
 {
+  int i, level;
+
+  seqlock_init (&ticks_seqlock);
+  list_init (&sleep_list);
+  for (i = 0; i < WHEEL0_SIZE; i++)
+    list_init (&wheel0[i]);
+  for (level = 0; level < WHEEL_LEVELS - 1; level++)
+    for (i = 0; i < WHEELN_SIZE; i++)
+      list_init (&wheeln[level][i]);
   pit_configure_channel (0, 2, TIMER_FREQ);
   intr_register_ext (0x20, timer_interrupt, "8254 Timer");
 }
 
-/* Calibrates loops_per_tick, used to implement brief delays. */
+/* Calibrates loops_per_tick, used to implement brief delays.
+
+   If the high-resolution clock has been calibrated, this times
+   the delay loop against the TSC, which takes well under a
+   tick.  Otherwise, it falls back to a binary search that
+   waits for about 20 timer ticks.  If loops_per_tick was given
+   on the kernel command line, this only reports it. */
 void
 timer_calibrate (void) 
 {
-  unsigned high_bit, test_bit;
-
   ASSERT (intr_get_level () == INTR_ON);
   printf ("Calibrating timer...  ");
 
-  /* Approximate loops_per_tick as the largest power-of-two
-     still less than one timer tick. */
-  loops_per_tick = 1u << 10;
-  while (!too_many_loops (loops_per_tick << 1)) 
+  if (loops_per_tick == 0)
+    loops_per_tick = (clock_calibrated ()
+                      ? calibrate_with_tsc ()
+                      : calibrate_with_ticks ());
+
+  printf ("%'"PRIu64" loops/s (-lpt=%u).\n",
+          (uint64_t) loops_per_tick * TIMER_FREQ, loops_per_tick);
+}
+
+/* Sets loops_per_tick to LOOPS, so that timer_calibrate() does
+   not need to measure it.  For use by the "-lpt" kernel
+   command-line option, with a value printed by an earlier
+   boot. */
+void
+timer_set_loops_per_tick (unsigned loops) 
+{
+  loops_per_tick = loops;
+}
+
+/* Measures and returns the rate of the CPU's time-stamp counter,
+   in cycles per second, by reading it at the start and end of
+   one period of PIT channel 0, which must be running
+   periodically.  Interrupts are turned off meanwhile, so the
+   measurement takes one timer tick and delays at most one
+   timer interrupt. */
+uint64_t
+timer_measure_tsc (void) 
+{
+  enum intr_level old_level;
+  unsigned elapsed = 0;
+  uint64_t start_tsc, end_tsc;
+  uint16_t prev;
+  bool output;
+
+  old_level = intr_disable ();
+  ASSERT (tickless_ticks == 0);
+  prev = pit_read_count (0, &output);
+  start_tsc = clock_rdtsc ();
+  while (elapsed < TICK_CYCLES) 
     {
-      loops_per_tick <<= 1;
-      ASSERT (loops_per_tick != 0);
+      /* In mode 2 the count runs down to 1, then reloads. */
+      uint16_t count = pit_read_count (0, &output);
+      elapsed += count <= prev ? prev - count : prev + TICK_CYCLES - count;
+      prev = count;
     }
+  end_tsc = clock_rdtsc ();
+  intr_set_level (old_level);
 
-  /* Refine the next 8 bits of loops_per_tick. */
-  high_bit = loops_per_tick;
-  for (test_bit = high_bit >> 1; test_bit != high_bit >> 10; test_bit >>= 1)
-    if (!too_many_loops (high_bit | test_bit))
-      loops_per_tick |= test_bit;
-
-  printf ("%'"PRIu64" loops/s.\n", (uint64_t) loops_per_tick * TIMER_FREQ);
+  return (end_tsc - start_tsc) * PIT_HZ / elapsed;
 }
 
 /* Returns the number of timer ticks since the OS booted. */
 int64_t
 timer_ticks (void) 
 {
-  enum intr_level old_level = intr_disable ();
-  int64_t t = ticks;
-  intr_set_level (old_level);
+  unsigned seq;
+  int64_t t;
+
+  do 
+    {
+      seq = seqlock_read_begin (&ticks_seqlock);
+      t = ticks;
+    }
+  while (seqlock_read_retry (&ticks_seqlock, seq));
   return t;
 }
 
@@ -85,15 +212,29 @@ timer_elapsed (int64_t then)
 }
 
 /* Sleeps for approximately TICKS timer ticks.  Interrupts must
-   be turned on. */
+   be turned on.
+
+   The calling thread is blocked on sleep_list until the timer
+   interrupt handler finds that its wake-up time has arrived, so
+   a sleeping thread consumes no CPU time at all. */
 void
 timer_sleep (int64_t ticks) 
 {
   int64_t start = timer_ticks ();
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
 
   ASSERT (intr_get_level () == INTR_ON);
-  while (timer_elapsed (start) < ticks) 
-    thread_yield ();
+  if (ticks <= 0)
+    return;
+
+  old_level = intr_disable ();
+  cur->wakeup_tick = start + ticks;
+  list_insert_ordered (&sleep_list, &cur->elem, wakeup_less, NULL);
+  spinlock_acquire (&sched_lock);
+  thread_block ();
+  spinlock_release (&sched_lock);
+  intr_set_level (old_level);
 }
 
 /* Sleeps for approximately MS milliseconds.  Interrupts must be
@@ -159,19 +300,403 @@ timer_ndelay (int64_t ns)
   real_time_delay (ns, 1000 * 1000 * 1000);
 }
 
+/* Initializes timer event EVENT to call FUNC(AUX) when it
+   expires.  FUNC will be called from the timer interrupt
+   handler, after the tick has otherwise been fully accounted
+   for, so it should do little more than wake a thread or post
+   work to a work queue (see threads/workqueue.h). */
+void
+timer_event_init (struct timer_event *event, timer_event_func *func,
+                  void *aux) 
+{
+  ASSERT (event != NULL);
+  ASSERT (func != NULL);
+
+  event->func = func;
+  event->aux = aux;
+  event->pending = false;
+}
+
+/* Schedules EVENT to expire TICKS timer ticks from now, or at
+   the next tick if TICKS is 0 or less.  Returns false, without
+   changing anything, if EVENT is already scheduled.  May be
+   called from an interrupt handler. */
+bool
+timer_event_schedule (struct timer_event *event, int64_t ticks) 
+{
+  enum intr_level old_level;
+  bool ok = false;
+
+  ASSERT (event != NULL);
+
+  old_level = intr_disable ();
+  if (!event->pending) 
+    {
+      event->when = timer_ticks () + (ticks > 0 ? ticks : 1);
+      event->pending = true;
+      wheel_add (event);
+      ok = true;
+    }
+  intr_set_level (old_level);
+
+  return ok;
+}
+
+/* Cancels EVENT.  Returns true if it was scheduled, false if it
+   was not, either because it was never scheduled or because it
+   already expired.  May be called from an interrupt handler. */
+bool
+timer_event_cancel (struct timer_event *event) 
+{
+  enum intr_level old_level;
+  bool was_pending;
+
+  ASSERT (event != NULL);
+
+  old_level = intr_disable ();
+  was_pending = event->pending;
+  if (was_pending) 
+    {
+      list_remove (&event->elem);
+      event->pending = false;
+      event_cnt--;
+    }
+  intr_set_level (old_level);
+
+  return was_pending;
+}
+
+/* Called by the idle thread, with interrupts off, just before
+   it halts the CPU.  If tickless idle is enabled, reprograms the
+   PIT to interrupt just once, at the earliest tick at which a
+   sleeping thread must wake up or a timer event expires, instead
+   of every tick.  The PIT can only count so far, so this is at
+   most TICKLESS_MAX_TICKS ticks away.
+
+   Under the MLFQS, the one-shot never extends past the next
+   once-per-second update, which timer_idle_exit() does not
+   perform.
+
+   Tickless idle is not used once more than one CPU may be
+   running, because the other CPUs' ticks come from this timer
+   too. */
+void
+timer_idle_enter (void) 
+{
+  int64_t n = TICKLESS_MAX_TICKS;
+  unsigned ofs;
+  bool output;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (!timer_tickless || cpu_smp || tickless_ticks != 0)
+    return;
+
+  if (!list_empty (&sleep_list)) 
+    {
+      struct thread *t = list_entry (list_front (&sleep_list),
+                                     struct thread, elem);
+      if (t->wakeup_tick - ticks < n)
+        n = t->wakeup_tick - ticks;
+    }
+  if (event_cnt > 0 && wheel_next_event () - ticks < n)
+    n = wheel_next_event () - ticks;
+  if (thread_mlfqs && TIMER_FREQ - ticks % TIMER_FREQ < n)
+    n = TIMER_FREQ - ticks % TIMER_FREQ;
+  if (n < 2)
+    return;
+
+  /* Keep the one-shot in phase with the periodic ticks by
+     subtracting the part of the current period already gone. */
+  ofs = TICK_CYCLES - pit_read_count (0, &output);
+  tickless_ticks = n;
+  tickless_ofs = ofs;
+  tickless_count = n * TICK_CYCLES - ofs;
+  pit_start_one_shot (0, tickless_count);
+}
+
+/* Called with interrupts off when the idle thread is about to
+   be switched out, or to block again after waking up.  If the
+   PIT is counting down a one-shot started by timer_idle_enter(),
+   brings `ticks' up to date and shortens the one-shot to end at
+   the next tick boundary, when timer_interrupt() will resume
+   periodic ticks.  Returns the number of ticks added, all of
+   which the CPU spent idle. */
+int64_t
+timer_idle_exit (void) 
+{
+  unsigned count, elapsed;
+  int64_t n;
+  bool expired;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (tickless_ticks <= 1)
+    return 0;
+
+  /* If the one-shot has expired, or is about to, its interrupt
+     is pending, and timer_interrupt() will do the work. */
+  count = pit_read_count (0, &expired);
+  if (expired || count < TICKLESS_SLOP)
+    return 0;
+
+  elapsed = tickless_ofs + (tickless_count - count);
+  n = elapsed / TICK_CYCLES;
+  seqlock_write_begin (&ticks_seqlock);
+  ticks += n;
+  seqlock_write_end (&ticks_seqlock);
+  tickless_skipped += n;
+
+  tickless_ticks = 1;
+  tickless_ofs = elapsed % TICK_CYCLES;
+  tickless_count = TICK_CYCLES - tickless_ofs;
+  pit_start_one_shot (0, tickless_count);
+  return n;
+}
+
 /* Prints timer statistics. */
 void
 timer_print_stats (void) 
 {
   printf ("Timer: %"PRId64" ticks\n", timer_ticks ());
+  if (timer_tickless)
+    printf ("Timer: %"PRId64" interrupts skipped while idle\n",
+            tickless_skipped);
 }
 
-/* Timer interrupt handler. */
+/* Timer interrupt handler.  Normally this counts one tick, but
+   if the interrupt ends a tickless idle period then every tick
+   in that period is counted now.  (A periodic tick that was
+   already pending when the period began arrives before the
+   one-shot does, and is counted as just one tick.) */
 static void
 timer_interrupt (struct intr_frame *args UNUSED)
 {
+  int n = 1;
+
+  if (tickless_ticks != 0) 
+    {
+      bool expired;
+
+      pit_read_count (0, &expired);
+      if (expired) 
+        {
+          n = tickless_ticks;
+          tickless_skipped += n - 1;
+          tickless_ticks = 0;
+          pit_configure_channel (0, 2, TIMER_FREQ);
+        }
+    }
+
+  while (n-- > 0)
+    timer_tick ();
+
+  /* The APs get no timer interrupts of their own. */
+  if (cpu_cnt > 1)
+    cpu_tick_others ();
+}
+
+/* Counts one timer tick.  Wakes up every sleeping thread whose
+   wake-up time has arrived and runs every timer event that has
+   expired.  Because sleep_list is sorted, this only examines
+   the threads that actually wake up, plus one more. */
+static void
+timer_tick (void) 
+{
+  seqlock_write_begin (&ticks_seqlock);
   ticks++;
+  seqlock_write_end (&ticks_seqlock);
+  while (!list_empty (&sleep_list)) 
+    {
+      struct thread *t = list_entry (list_front (&sleep_list),
+                                     struct thread, elem);
+      if (t->wakeup_tick > ticks)
+        break;
+      list_pop_front (&sleep_list);
+      thread_unblock (t);
+    }
   thread_tick ();
+  wheel_run ();
+}
+
+/* Returns true if thread A wakes up before thread B, false
+   otherwise. */
+static bool
+wakeup_less (const struct list_elem *a_, const struct list_elem *b_,
+             void *aux UNUSED) 
+{
+  const struct thread *a = list_entry (a_, struct thread, elem);
+  const struct thread *b = list_entry (b_, struct thread, elem);
+
+  return a->wakeup_tick < b->wakeup_tick;
+}
+
+/* Adds EVENT to the wheel slot for its expiration time.
+   Interrupts must be off. */
+static void
+wheel_add (struct timer_event *event) 
+{
+  int64_t when = event->when;
+  int64_t delta = when - wheel_time;
+  struct list *slot;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (delta < 0) 
+    {
+      /* Already due: run it when the current slot is processed. */
+      when = wheel_time;
+      delta = 0;
+    }
+  else if (delta >= WHEEL_MAX_DELTA) 
+    {
+      /* Too far away for the wheel.  Park it in the last slot
+         reachable; cascading will move it along. */
+      delta = WHEEL_MAX_DELTA - 1;
+      when = wheel_time + delta;
+    }
+
+  if (delta < WHEEL0_SIZE)
+    slot = &wheel0[when & WHEEL0_MASK];
+  else 
+    {
+      int level = 0;
+      int shift = WHEEL0_BITS;
+
+      while (delta >= 1LL << (shift + WHEELN_BITS)) 
+        {
+          level++;
+          shift += WHEELN_BITS;
+        }
+      slot = &wheeln[level][(when >> shift) & WHEELN_MASK];
+    }
+  list_push_back (slot, &event->elem);
+  event_cnt++;
+}
+
+/* Redistributes the events in slot INDEX of coarse level LEVEL
+   into finer slots, and returns INDEX.  Interrupts must be
+   off. */
+static int
+wheel_cascade (int level, int index) 
+{
+  struct list *slot = &wheeln[level][index];
+
+  while (!list_empty (slot)) 
+    {
+      struct timer_event *e = list_entry (list_pop_front (slot),
+                                          struct timer_event, elem);
+      event_cnt--;
+      wheel_add (e);
+    }
+  return index;
+}
+
+/* Runs every timer event in the wheel whose expiration time is
+   no later than the current tick, cascading coarser levels as
+   the finest level wraps around.  Interrupts must be off. */
+static void
+wheel_run (void) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  while (wheel_time <= ticks) 
+    {
+      int index = wheel_time & WHEEL0_MASK;
+      struct list expired;
+      int level;
+
+      /* Each time a level wraps around to slot 0, cascade the
+         next slot of the level above it. */
+      for (level = 0; index == 0 && level < WHEEL_LEVELS - 1; level++)
+        index = wheel_cascade (level, (wheel_time >> (WHEEL0_BITS
+                                                      + level * WHEELN_BITS))
+                                      & WHEELN_MASK);
+      index = wheel_time & WHEEL0_MASK;
+      wheel_time++;
+
+      /* Detach the slot's events before running any of them, in
+         case one reschedules itself. */
+      list_init (&expired);
+      while (!list_empty (&wheel0[index]))
+        list_push_back (&expired, list_pop_front (&wheel0[index]));
+      while (!list_empty (&expired)) 
+        {
+          struct timer_event *e = list_entry (list_pop_front (&expired),
+                                              struct timer_event, elem);
+          event_cnt--;
+          e->pending = false;
+          e->func (e->aux);
+        }
+    }
+}
+
+/* Returns the earliest tick at which the wheel needs attention:
+   either the expiration time of the next event in the finest
+   level, or the next time that a coarser level must be
+   cascaded, whichever comes first.  Interrupts must be off and
+   there must be at least one event in the wheel. */
+static int64_t
+wheel_next_event (void) 
+{
+  int64_t t;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (event_cnt > 0);
+
+  for (t = wheel_time; ; t++)
+    if (!list_empty (&wheel0[t & WHEEL0_MASK])
+        || (t != wheel_time && (t & WHEEL0_MASK) == 0))
+      return t;
+}
+
+/* Returns the number of busy_wait() loops per timer tick,
+   measured against the calibrated TSC.  Doubles the number of
+   loops timed until the run takes at least 1/16 of a tick, then
+   scales up. */
+static unsigned
+calibrate_with_tsc (void) 
+{
+  uint64_t tick_cycles = clock_tsc_hz () / TIMER_FREQ;
+  uint64_t cycles;
+  unsigned loops;
+
+  for (loops = 1u << 10; ; loops <<= 1) 
+    {
+      enum intr_level old_level = intr_disable ();
+      uint64_t start = clock_rdtsc ();
+      busy_wait (loops);
+      cycles = clock_rdtsc () - start;
+      intr_set_level (old_level);
+
+      if (cycles >= tick_cycles / 16 || loops >= 1u << 30)
+        break;
+    }
+  return loops * tick_cycles / cycles;
+}
+
+/* Returns the number of busy_wait() loops per timer tick, found
+   by a binary search that waits for many timer ticks. */
+static unsigned
+calibrate_with_ticks (void) 
+{
+  unsigned loops, high_bit, test_bit;
+
+  /* Approximate loops_per_tick as the largest power-of-two
+     still less than one timer tick. */
+  loops = 1u << 10;
+  while (!too_many_loops (loops << 1)) 
+    {
+      loops <<= 1;
+      ASSERT (loops != 0);
+    }
+
+  /* Refine the next 8 bits of loops_per_tick. */
+  high_bit = loops;
+  for (test_bit = high_bit >> 1; test_bit != high_bit >> 10; test_bit >>= 1)
+    if (!too_many_loops (high_bit | test_bit))
+      loops |= test_bit;
+  return loops;
 }
 
 /* Returns true if LOOPS iterations waits for more than one timer
@@ -220,7 +745,18 @@ real_time_sleep (int64_t num, int32_t denom)
   int64_t ticks = num * TIMER_FREQ / denom;
 
   ASSERT (intr_get_level () == INTR_ON);
-  if (ticks > 0)
+  if (clock_calibrated ()) 
+    {
+      /* Sleep for the whole ticks, which ends somewhere in the
+         last of them, then busy-wait on the high-resolution
+         clock for the rest. */
+      uint64_t deadline = clock_ns () + num * (NSEC_PER_SEC / denom);
+      if (ticks > 0)
+        timer_sleep (ticks);
+      while (clock_ns () < deadline)
+        barrier ();
+    }
+  else if (ticks > 0)
     {
       /* We're waiting for at least one full timer tick.  Use
          timer_sleep() because it will yield the CPU to other
@@ -239,6 +775,16 @@ real_time_sleep (int64_t num, int32_t denom)
 static void
 real_time_delay (int64_t num, int32_t denom)
 {
+  /* Once the high-resolution clock is running, spin on it,
+     which is accurate regardless of interrupts and CPU speed. */
+  if (clock_calibrated ()) 
+    {
+      uint64_t deadline = clock_ns () + num * (NSEC_PER_SEC / denom);
+      while (clock_ns () < deadline)
+        barrier ();
+      return;
+    }
+
   /* Scale the numerator and denominator down by 1000 to avoid
      the possibility of overflow. */
   ASSERT (denom % 1000 == 0);
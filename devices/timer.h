@@ -1,14 +1,23 @@
 #ifndef DEVICES_TIMER_H
 #define DEVICES_TIMER_H
 
+#include <list.h>
 #include <round.h>
+#include <stdbool.h>
 #include <stdint.h>
 
 /* Number of timer interrupts per second. */
 #define TIMER_FREQ 100
 
+/* If false (default), the timer interrupts every tick.
+   If true, the timer stops ticking while the CPU is idle.
+   Controlled by kernel command-line option "-tickless". */
+extern bool timer_tickless;
+
 void timer_init (void);
 void timer_calibrate (void);
+void timer_set_loops_per_tick (unsigned);
+uint64_t timer_measure_tsc (void);
 
 int64_t timer_ticks (void);
 int64_t timer_elapsed (int64_t);
@@ -24,6 +33,29 @@ void timer_mdelay (int64_t milliseconds);
 void timer_udelay (int64_t microseconds);
 void timer_ndelay (int64_t nanoseconds);
 
+/* A function for the timer interrupt handler to call later. */
+typedef void timer_event_func (void *aux);
+
+/* A timer event.  Once scheduled, FUNC(AUX) is called from the
+   timer interrupt handler at the requested tick, so it must not
+   sleep. */
+struct timer_event
+  {
+    struct list_elem elem;      /* Element in the event list. */
+    int64_t when;               /* Tick to run at. */
+    timer_event_func *func;     /* Function to call. */
+    void *aux;                  /* Argument to FUNC. */
+    bool pending;               /* Scheduled but not yet run? */
+  };
+
+void timer_event_init (struct timer_event *, timer_event_func *, void *aux);
+bool timer_event_schedule (struct timer_event *, int64_t ticks);
+bool timer_event_cancel (struct timer_event *);
+
+/* Tickless idle. */
+void timer_idle_enter (void);
+int64_t timer_idle_exit (void);
+
 void timer_print_stats (void);
 
 #endif /* devices/timer.h */
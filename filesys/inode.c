@@ -5,7 +5,9 @@
 #include <string.h>
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
+#include "threads/interrupt.h"
 #include "threads/malloc.h"
+#include "threads/synch.h"
 
 /* Identifies an inode. */
 #define INODE_MAGIC 0x494e4f44
@@ -36,6 +38,7 @@ struct inode
     int open_cnt;                       /* Number of openers. */
     bool removed;                       /* True if deleted, false otherwise. */
     int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
+    struct semaphore loaded;            /* Upped once DATA has been read. */
     struct inode_disk data;             /* Inode content. */
   };
 
@@ -54,14 +57,31 @@ byte_to_sector (const struct inode *inode, off_t pos)
 }
 
 /* List of open inodes, so that opening a single inode twice
-   returns the same `struct inode'. */
+   returns the same `struct inode'.  Opening an inode that is
+   already open only needs to search the list, so the list is
+   protected by a readers-writer lock.  An inode goes on the list
+   before its on-disk data has been read, so that the lock need
+   not be held across the read; see inode_open(). */
 static struct list open_inodes;
+static struct rwlock open_inodes_lock;
+
+/* Cache of struct inode, which is a little over 512 bytes and
+   so would take a 1 kB block from malloc(). */
+static struct kmem_cache *inode_cache;
+
+static struct inode *find_open_inode (block_sector_t);
+static struct inode *reopen (struct inode *);
+static struct inode *wait_loaded (struct inode *);
 
 /* Initializes the inode module. */
 void
 inode_init (void) 
 {
   list_init (&open_inodes);
+  rwlock_init (&open_inodes_lock);
+  inode_cache = kmem_cache_create ("inode", sizeof (struct inode), NULL);
+  if (inode_cache == NULL)
+    PANIC ("inode_init: out of memory");
 }
 
 /* Initializes an inode with LENGTH bytes of data and
@@ -111,42 +131,103 @@ inode_create (block_sector_t sector, off_t length)
 struct inode *
 inode_open (block_sector_t sector)
 {
-  struct list_elem *e;
   struct inode *inode;
 
   /* Check whether this inode is already open. */
-  for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
-       e = list_next (e)) 
+  rwlock_acquire_read (&open_inodes_lock);
+  inode = find_open_inode (sector);
+  rwlock_release_read (&open_inodes_lock);
+  if (inode != NULL)
+    return wait_loaded (inode);
+
+  /* Check again, since another thread may have opened the inode
+     before we acquired the lock for writing. */
+  rwlock_acquire_write (&open_inodes_lock);
+  inode = find_open_inode (sector);
+  if (inode != NULL) 
     {
-      inode = list_entry (e, struct inode, elem);
-      if (inode->sector == sector) 
-        {
-          inode_reopen (inode);
-          return inode; 
-        }
+      rwlock_release_write (&open_inodes_lock);
+      return wait_loaded (inode);
     }
 
   /* Allocate memory. */
-  inode = malloc (sizeof *inode);
-  if (inode == NULL)
-    return NULL;
+  inode = kmem_cache_alloc (inode_cache);
+  if (inode == NULL) 
+    {
+      rwlock_release_write (&open_inodes_lock);
+      return NULL;
+    }
 
-  /* Initialize. */
+  /* Initialize and add to the list, but read the on-disk inode
+     only after releasing the lock, so that other threads need
+     not wait for the read to open or close other inodes.  Those
+     that open this one wait in wait_loaded() instead. */
   list_push_front (&open_inodes, &inode->elem);
   inode->sector = sector;
   inode->open_cnt = 1;
   inode->deny_write_cnt = 0;
   inode->removed = false;
+  sema_init (&inode->loaded, 0);
+  rwlock_release_write (&open_inodes_lock);
+
   block_read (fs_device, inode->sector, &inode->data);
+  sema_up (&inode->loaded);
+  return inode;
+}
+
+/* Waits until the thread that first opened INODE has read its
+   on-disk data, then returns INODE. */
+static struct inode *
+wait_loaded (struct inode *inode) 
+{
+  sema_down (&inode->loaded);
+  sema_up (&inode->loaded);
   return inode;
 }
 
+/* Returns the open inode for SECTOR, reopened, or a null pointer
+   if SECTOR's inode is not open.  The caller must hold
+   open_inodes_lock, for reading or writing. */
+static struct inode *
+find_open_inode (block_sector_t sector) 
+{
+  struct list_elem *e;
+
+  for (e = list_begin (&open_inodes); e != list_end (&open_inodes);
+       e = list_next (e)) 
+    {
+      struct inode *inode = list_entry (e, struct inode, elem);
+      if (inode->sector == sector) 
+        return reopen (inode);
+    }
+  return NULL;
+}
+
 /* Reopens and returns INODE. */
 struct inode *
 inode_reopen (struct inode *inode)
 {
-  if (inode != NULL)
-    inode->open_cnt++;
+  if (inode != NULL) 
+    {
+      rwlock_acquire_read (&open_inodes_lock);
+      reopen (inode);
+      rwlock_release_read (&open_inodes_lock);
+    }
+  return inode;
+}
+
+/* Increments INODE's open count and returns INODE.  The caller
+   must hold open_inodes_lock.  Holding it for reading keeps
+   inode_close(), which changes open_cnt only while holding it
+   for writing, out of the way, but several readers may reopen
+   the same inode at once, so the increment itself is done with
+   interrupts off. */
+static struct inode *
+reopen (struct inode *inode) 
+{
+  enum intr_level old_level = intr_disable ();
+  inode->open_cnt++;
+  intr_set_level (old_level);
   return inode;
 }
 
@@ -168,10 +249,12 @@ inode_close (struct inode *inode)
     return;
 
   /* Release resources if this was the last opener. */
+  rwlock_acquire_write (&open_inodes_lock);
   if (--inode->open_cnt == 0)
     {
       /* Remove from inode list and release lock. */
       list_remove (&inode->elem);
+      rwlock_release_write (&open_inodes_lock);
  
       /* Deallocate blocks if removed. */
       if (inode->removed) 
@@ -181,8 +264,10 @@ inode_close (struct inode *inode)
                             bytes_to_sectors (inode->data.length)); 
         }
 
-      free (inode); 
+      kmem_cache_free (inode_cache, inode); 
     }
+  else
+    rwlock_release_write (&open_inodes_lock);
 }
 
 /* Marks INODE to be deleted when it is closed by the last caller who
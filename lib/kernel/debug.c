@@ -9,6 +9,7 @@
 #include "threads/interrupt.h"
 #include "threads/thread.h"
 #include "threads/switch.h"
+#include "threads/synch.h"
 #include "threads/vaddr.h"
 #include "devices/serial.h"
 #include "devices/shutdown.h"
@@ -118,6 +119,8 @@ debug_backtrace_all (void)
 {
   enum intr_level oldlevel = intr_disable ();
 
+  spinlock_acquire (&sched_lock);
   thread_foreach (print_stacktrace, 0);
+  spinlock_release (&sched_lock);
   intr_set_level (oldlevel);
 }
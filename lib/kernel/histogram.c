@@ -0,0 +1,78 @@
+#include "histogram.h"
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+
+/* Width of the bar drawn for the fullest bucket. */
+#define BAR_WIDTH 40
+
+/* Initializes H as an empty histogram. */
+void
+histogram_init (struct histogram *h) 
+{
+  ASSERT (h != NULL);
+
+  memset (h, 0, sizeof *h);
+}
+
+/* Adds VALUE to H.  Negative values count as 0, and values of
+   2**32 or more go in the last bucket. */
+void
+histogram_add (struct histogram *h, int64_t value) 
+{
+  int bucket;
+
+  ASSERT (h != NULL);
+
+  if (value < 0)
+    value = 0;
+  if (value == 0)
+    bucket = 0;
+  else if (value > UINT32_MAX)
+    bucket = HISTOGRAM_BUCKETS - 1;
+  else
+    bucket = 32 - __builtin_clz ((uint32_t) value);
+
+  h->buckets[bucket]++;
+  h->cnt++;
+  h->sum += value;
+  if (value > h->max)
+    h->max = value;
+}
+
+/* Prints H to the console under the heading TITLE, one line per
+   bucket from the lowest to the highest nonempty bucket. */
+void
+histogram_print (const struct histogram *h, const char *title) 
+{
+  long long peak = 0;
+  int lo, hi, b;
+
+  ASSERT (h != NULL);
+  ASSERT (title != NULL);
+
+  printf ("%s: %lld samples, mean %lld, max %lld\n", title, h->cnt,
+          h->cnt > 0 ? (long long) (h->sum / h->cnt) : 0LL,
+          (long long) h->max);
+  if (h->cnt == 0)
+    return;
+
+  for (lo = 0; h->buckets[lo] == 0; lo++)
+    continue;
+  for (hi = HISTOGRAM_BUCKETS - 1; h->buckets[hi] == 0; hi--)
+    continue;
+  for (b = lo; b <= hi; b++)
+    if (h->buckets[b] > peak)
+      peak = h->buckets[b];
+
+  for (b = lo; b <= hi; b++) 
+    {
+      long long low = b == 0 ? 0 : 1LL << (b - 1);
+      int bar = h->buckets[b] * BAR_WIDTH / peak;
+
+      printf ("  %10lld+ %10lld |", low, h->buckets[b]);
+      while (bar-- > 0)
+        putchar ('*');
+      putchar ('\n');
+    }
+}
@@ -0,0 +1,32 @@
+#ifndef __LIB_KERNEL_HISTOGRAM_H
+#define __LIB_KERNEL_HISTOGRAM_H
+
+#include <stdint.h>
+
+/* Log2 histogram.
+
+   Counts nonnegative values in buckets whose bounds are powers
+   of 2: bucket 0 holds the value 0, and bucket B > 0 holds values
+   V with 2**(B-1) <= V < 2**B.  Adding a value takes constant
+   time, and a histogram takes the same space whatever its range,
+   so histograms are suitable for recording latencies and queue
+   lengths in hot paths.
+
+   A histogram does no locking of its own. */
+
+/* Number of buckets, enough for any 32-bit value. */
+#define HISTOGRAM_BUCKETS 33
+
+struct histogram 
+  {
+    long long buckets[HISTOGRAM_BUCKETS]; /* Count per bucket. */
+    long long cnt;                      /* Number of values added. */
+    int64_t sum;                        /* Sum of values added. */
+    int64_t max;                        /* Largest value added. */
+  };
+
+void histogram_init (struct histogram *);
+void histogram_add (struct histogram *, int64_t value);
+void histogram_print (const struct histogram *, const char *title);
+
+#endif /* lib/kernel/histogram.h */
@@ -0,0 +1,109 @@
+/* Test program for the batched TLB invalidation in
+   userprog/pagedir.c.
+
+   Maps a range of user pages in the running thread's page
+   directory, touches each page so that its translation is in
+   the TLB, unmaps the range with pagedir_clear_page_deferred()
+   and pagedir_flush(), and then maps the same range to a
+   different frame.  If any invalidation was lost, a read
+   through the stale TLB entry returns the old frame's contents.
+   This is done for fewer pages than PAGEDIR_FLUSH_MAX, which
+   invalidates them one by one, and for more, which flushes the
+   whole TLB.
+
+   This is not a test we will run on your submitted projects.
+   It is here for completeness.
+*/
+
+#undef NDEBUG
+#include <debug.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/palloc.h"
+#include "threads/test.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include "userprog/pagedir.h"
+#include "userprog/process.h"
+
+/* First user page of the range we map. */
+#define BASE ((uint8_t *) 0x10000000)
+
+static void test_range (uint32_t *pd, size_t page_cnt,
+                        uint8_t *old_frame, uint8_t *new_frame);
+
+/* Test pagedir_flush() for batches of various sizes. */
+void
+test (void)
+{
+  struct thread *t = thread_current ();
+  uint8_t *old_frame, *new_frame;
+  uint32_t *pd;
+
+  ASSERT (t->pagedir == NULL);
+
+  pd = pagedir_create ();
+  old_frame = palloc_get_page (PAL_USER);
+  new_frame = palloc_get_page (PAL_USER);
+  ASSERT (pd != NULL && old_frame != NULL && new_frame != NULL);
+  memset (old_frame, 'o', PGSIZE);
+  memset (new_frame, 'n', PGSIZE);
+
+  /* Make PD the active page directory, the way a process's is,
+     so that it stays active across context switches. */
+  t->pagedir = pd;
+  process_activate ();
+
+  printf ("testing batched TLB invalidation:");
+  test_range (pd, 1, old_frame, new_frame);
+  test_range (pd, PAGEDIR_FLUSH_MAX / 2, old_frame, new_frame);
+  test_range (pd, PAGEDIR_FLUSH_MAX, old_frame, new_frame);
+  test_range (pd, PAGEDIR_FLUSH_MAX + 1, old_frame, new_frame);
+  test_range (pd, PAGEDIR_FLUSH_MAX * 4, old_frame, new_frame);
+  printf (" done\n");
+
+  t->pagedir = NULL;
+  pagedir_activate (NULL);
+  pagedir_destroy (pd);
+  palloc_free_page (old_frame);
+  palloc_free_page (new_frame);
+
+  printf ("pagedir: PASS\n");
+}
+
+/* Maps PAGE_CNT pages starting at BASE in PD, which must be
+   active, to OLD_FRAME, unmaps them with a single batch, and
+   checks that they are unmapped and that remapping them to
+   NEW_FRAME takes effect. */
+static void
+test_range (uint32_t *pd, size_t page_cnt,
+            uint8_t *old_frame, uint8_t *new_frame)
+{
+  struct pagedir_flush flush;
+  size_t i;
+
+  printf (" %zu", page_cnt);
+
+  for (i = 0; i < page_cnt; i++)
+    {
+      uint8_t *upage = BASE + i * PGSIZE;
+      ASSERT (pagedir_set_page (pd, upage, old_frame, true));
+      ASSERT (*upage == 'o');
+    }
+
+  pagedir_flush_init (&flush, pd);
+  for (i = 0; i < page_cnt; i++)
+    pagedir_clear_page_deferred (&flush, BASE + i * PGSIZE);
+  pagedir_flush (&flush);
+
+  for (i = 0; i < page_cnt; i++)
+    {
+      uint8_t *upage = BASE + i * PGSIZE;
+      ASSERT (pagedir_get_page (pd, upage) == NULL);
+      ASSERT (pagedir_set_page (pd, upage, new_frame, true));
+      ASSERT (*upage == 'n');
+    }
+
+  for (i = 0; i < page_cnt; i++)
+    pagedir_clear_page (pd, BASE + i * PGSIZE);
+}
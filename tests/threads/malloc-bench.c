@@ -0,0 +1,78 @@
+/* Measures malloc() and free() throughput with 1, 2, 4, and 8
+   kernel threads allocating and freeing at once, and reports
+   how long each round took, in total and per pair of malloc()
+   and free() calls.
+
+   Each thread keeps a small window of live blocks of assorted
+   sizes, freeing the oldest block before allocating a new one,
+   so that most requests can be satisfied from recently freed
+   blocks.  The threads are preempted at timer ticks, so they
+   contend for whatever the allocator locks.  Comparing the
+   reported times across kernels shows the effect of changes to
+   the allocator's fast paths. */
+
+#include <stdio.h>
+#include <inttypes.h>
+#include "tests/threads/tests.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/clock.h"
+
+#define MAX_THREADS 8
+#define ITER_CNT 20000
+#define WINDOW 8
+
+static thread_func alloc_thread;
+
+void
+test_malloc_bench (void) 
+{
+  struct semaphore done;
+  int thread_cnt;
+
+  sema_init (&done, 0);
+
+  for (thread_cnt = 1; thread_cnt <= MAX_THREADS; thread_cnt *= 2) 
+    {
+      uint64_t start_ns, elapsed_ns;
+      int i;
+
+      start_ns = clock_ns ();
+      for (i = 0; i < thread_cnt; i++) 
+        if (thread_create ("bench", PRI_DEFAULT, alloc_thread, &done)
+            == TID_ERROR)
+          fail ("thread_create() failed");
+      for (i = 0; i < thread_cnt; i++)
+        sema_down (&done);
+      elapsed_ns = clock_ns () - start_ns;
+      msg ("%d threads x %d allocations: %"PRIu64" us, %"PRIu64" ns each.",
+           thread_cnt, ITER_CNT, elapsed_ns / 1000,
+           elapsed_ns / ((uint64_t) thread_cnt * ITER_CNT));
+    }
+  pass ();
+}
+
+static void
+alloc_thread (void *done_) 
+{
+  static const size_t sizes[] = {16, 24, 64, 100, 256, 520};
+  const size_t size_cnt = sizeof sizes / sizeof *sizes;
+  struct semaphore *done = done_;
+  void *window[WINDOW] = {NULL};
+  int i;
+
+  for (i = 0; i < ITER_CNT; i++) 
+    {
+      void **slot = &window[i % WINDOW];
+
+      free (*slot);
+      *slot = malloc (sizes[i % size_cnt]);
+      if (*slot == NULL)
+        fail ("malloc() failed");
+    }
+  for (i = 0; i < WINDOW; i++)
+    free (window[i]);
+
+  sema_up (done);
+}
@@ -0,0 +1,68 @@
+/* Uses up the kernel pool, then keeps calling malloc() until it
+   fails, so that malloc() has to refill a descriptor while the
+   page allocator has no pages left and falls back on draining
+   malloc()'s own magazines.  After everything is freed, malloc()
+   must work again. */
+
+#include <stddef.h>
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+
+/* Size of the blocks allocated with malloc(). */
+#define BLOCK_SIZE 16
+
+/* A page or block, linked into a list through its first bytes. */
+struct chunk 
+  {
+    struct chunk *next;
+  };
+
+void
+test_malloc_exhaust (void) 
+{
+  struct chunk *pages = NULL, *blocks = NULL, *c;
+  size_t page_cnt = 0, block_cnt = 0;
+  void *p;
+
+  /* Take every page in the kernel pool. */
+  while ((c = palloc_get_page (0)) != NULL) 
+    {
+      c->next = pages;
+      pages = c;
+      page_cnt++;
+    }
+
+  /* Allocate blocks until malloc() gives up. */
+  while ((c = malloc (BLOCK_SIZE)) != NULL) 
+    {
+      c->next = blocks;
+      blocks = c;
+      block_cnt++;
+    }
+
+  /* Give everything back. */
+  while (blocks != NULL) 
+    {
+      c = blocks;
+      blocks = c->next;
+      free (c);
+    }
+  while (pages != NULL) 
+    {
+      c = pages;
+      pages = c->next;
+      palloc_free_page (c);
+    }
+
+  if (page_cnt == 0)
+    fail ("no pages available");
+  msg ("malloc failed with the kernel pool used up");
+
+  p = malloc (BLOCK_SIZE);
+  if (p == NULL)
+    fail ("malloc failed after freeing everything");
+  free (p);
+  msg ("malloc works after freeing everything");
+}
@@ -0,0 +1,11 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(malloc-exhaust) begin
+(malloc-exhaust) malloc failed with the kernel pool used up
+(malloc-exhaust) malloc works after freeing everything
+(malloc-exhaust) end
+EOF
+pass;
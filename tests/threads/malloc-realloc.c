@@ -0,0 +1,67 @@
+/* Checks that realloc() preserves a block's contents as it grows
+   and shrinks across malloc()'s size classes and the boundary
+   between small and big blocks, whether it resizes the block in
+   place or moves it. */
+
+#include <stdio.h>
+#include <stdint.h>
+#include "tests/threads/tests.h"
+#include "threads/malloc.h"
+
+static void fill (uint8_t *, size_t ofs, size_t size);
+static void check (const uint8_t *, size_t size);
+
+void
+test_malloc_realloc (void) 
+{
+  static const size_t sizes[] = 
+    {
+      10, 1000, 1300, 2000, 2100, 5000, 20000, 65536,
+      40000, 8192, 4000, 1500, 100, 1,
+    };
+  const size_t size_cnt = sizeof sizes / sizeof *sizes;
+  uint8_t *p = NULL;
+  size_t old_size = 0;
+  size_t i;
+
+  for (i = 0; i < size_cnt; i++) 
+    {
+      size_t size = sizes[i];
+
+      p = realloc (p, size);
+      if (p == NULL)
+        fail ("realloc to %zu bytes failed", size);
+      check (p, old_size < size ? old_size : size);
+      if (size > old_size)
+        fill (p, old_size, size);
+      old_size = size;
+    }
+  msg ("contents preserved through %zu resizes", size_cnt);
+
+  p = realloc (p, 0);
+  if (p != NULL)
+    fail ("realloc to 0 bytes returned nonnull pointer");
+}
+
+/* Fills bytes OFS through SIZE - 1 of P with a pattern that
+   check() verifies. */
+static void
+fill (uint8_t *p, size_t ofs, size_t size) 
+{
+  size_t i;
+
+  for (i = ofs; i < size; i++)
+    p[i] = i % 251;
+}
+
+/* Verifies that the first SIZE bytes of P hold the pattern
+   written by fill(). */
+static void
+check (const uint8_t *p, size_t size) 
+{
+  size_t i;
+
+  for (i = 0; i < size; i++)
+    if (p[i] != i % 251)
+      fail ("byte %zu is %d, expected %d", i, p[i], (int) (i % 251));
+}
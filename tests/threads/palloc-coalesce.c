@@ -0,0 +1,142 @@
+/* Checks that the page allocator merges freed pages back into
+   large, aligned blocks.  Finds the longest run of kernel pages
+   that can be allocated, then allocates and frees many runs of
+   assorted sizes, freeing every other one first to break up free
+   memory.  Afterward, the longest run must be as long as before.
+
+   Then checks properties peculiar to a buddy allocator: runs of
+   2**k pages are aligned on 2**k pages relative to one another,
+   even with a 1-page run allocated between them, and the pieces
+   of a freed 32-page block merge back into a single block that
+   the next 32-page request gets.  Finally it allocates a run of
+   more than 1024 pages, the largest buddy block, which needs
+   more memory than the default, so this test runs with -m 32. */
+
+#include <stdint.h>
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+#define BLOCK_CNT 64
+#define LARGE_CNT 1536
+
+static size_t longest_run (void);
+static size_t pages_between (const void *, const void *);
+
+void
+test_palloc_coalesce (void) 
+{
+  void *blocks[BLOCK_CNT];
+  uint8_t *a, *b, *x, *q, *p;
+  size_t before, after;
+  int i;
+
+  before = longest_run ();
+  if (before <= LARGE_CNT)
+    fail ("only %zu contiguous pages available", before);
+
+  msg ("allocate %d runs", BLOCK_CNT);
+  for (i = 0; i < BLOCK_CNT; i++) 
+    {
+      blocks[i] = palloc_get_multiple (0, i % 7 + 1);
+      if (blocks[i] == NULL)
+        fail ("allocating run %d of %d pages failed", i, i % 7 + 1);
+    }
+
+  msg ("free odd runs, then even runs");
+  for (i = 1; i < BLOCK_CNT; i += 2)
+    palloc_free_multiple (blocks[i], i % 7 + 1);
+  for (i = 0; i < BLOCK_CNT; i += 2)
+    palloc_free_multiple (blocks[i], i % 7 + 1);
+
+  after = longest_run ();
+  if (after != before)
+    fail ("longest run was %zu pages, now %zu", before, after);
+  msg ("longest run unchanged");
+
+  /* Two 16-page runs with a 1-page run allocated between them.
+     A first-fit allocator would put them 17 pages apart. */
+  a = palloc_get_multiple (0, 16);
+  x = palloc_get_page (0);
+  b = palloc_get_multiple (0, 16);
+  if (a == NULL || x == NULL || b == NULL)
+    fail ("allocating 16 + 1 + 16 pages failed");
+  if (pages_between (a, b) % 16 != 0)
+    fail ("16-page runs are %zu pages apart", pages_between (a, b));
+  palloc_free_multiple (a, 16);
+  palloc_free_page (x);
+  palloc_free_multiple (b, 16);
+  msg ("16-page runs are aligned");
+
+  /* Free the upper half of a 64-page block in three pieces.
+     Its lower half is still in use, so the pieces merge into
+     exactly one free 32-page block, which the next 32-page
+     request must get. */
+  q = palloc_get_multiple (0, 64);
+  if (q == NULL)
+    fail ("allocating 64 pages failed");
+  palloc_free_multiple (q + 48 * PGSIZE, 16);
+  palloc_free_multiple (q + 32 * PGSIZE, 8);
+  palloc_free_multiple (q + 40 * PGSIZE, 8);
+  p = palloc_get_multiple (0, 32);
+  if (p != q + 32 * PGSIZE)
+    fail ("32-page run is %zu pages from the freed block",
+          pages_between (q + 32 * PGSIZE, p));
+  palloc_free_multiple (q, 64);
+  msg ("freed pieces merged into one aligned 32-page block");
+
+  /* More pages than the largest block holds. */
+  p = palloc_get_multiple (0, LARGE_CNT);
+  if (p == NULL)
+    fail ("allocating %d pages failed", LARGE_CNT);
+  palloc_free_multiple (p, LARGE_CNT);
+  msg ("allocated and freed %d pages", LARGE_CNT);
+
+  after = longest_run ();
+  if (after != before)
+    fail ("longest run was %zu pages, now %zu", before, after);
+  msg ("longest run unchanged");
+}
+
+/* Returns the number of pages from the lower of A and B to the
+   higher. */
+static size_t
+pages_between (const void *a, const void *b)
+{
+  uintptr_t pa = pg_no (a), pb = pg_no (b);
+  return pa < pb ? pb - pa : pa - pb;
+}
+
+/* Returns the number of pages in the longest run that can be
+   allocated from the kernel pool. */
+static size_t
+longest_run (void) 
+{
+  size_t lo = 0, hi = 1;
+  void *p;
+
+  /* Find an upper bound. */
+  while ((p = palloc_get_multiple (0, hi)) != NULL) 
+    {
+      palloc_free_multiple (p, hi);
+      lo = hi;
+      hi *= 2;
+    }
+
+  /* Binary search between LO, which fits, and HI, which does
+     not. */
+  while (hi - lo > 1) 
+    {
+      size_t mid = lo + (hi - lo) / 2;
+      p = palloc_get_multiple (0, mid);
+      if (p != NULL) 
+        {
+          palloc_free_multiple (p, mid);
+          lo = mid;
+        }
+      else
+        hi = mid;
+    }
+  return lo;
+}
@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(palloc-coalesce) begin
+(palloc-coalesce) allocate 64 runs
+(palloc-coalesce) free odd runs, then even runs
+(palloc-coalesce) longest run unchanged
+(palloc-coalesce) 16-page runs are aligned
+(palloc-coalesce) freed pieces merged into one aligned 32-page block
+(palloc-coalesce) allocated and freed 1536 pages
+(palloc-coalesce) longest run unchanged
+(palloc-coalesce) end
+EOF
+pass;
@@ -0,0 +1,69 @@
+/* Checks sema_down_timeout() and lock_acquire_timeout().
+
+   A higher-priority thread waits with a timeout for a lock that
+   the main thread holds, donating its priority, and gives up
+   while the main thread sleeps, which must withdraw the
+   donation.  Then the main thread waits with a timeout for a
+   semaphore that a lower-priority thread ups, which must
+   succeed. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "devices/timer.h"
+
+static thread_func waiter_thread_func;
+static thread_func upper_thread_func;
+
+void
+test_sema_timeout (void) 
+{
+  struct lock lock;
+  struct semaphore sema;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  /* Make sure our priority is the default. */
+  ASSERT (thread_get_priority () == PRI_DEFAULT);
+
+  lock_init (&lock);
+  lock_acquire (&lock);
+  thread_create ("waiter", PRI_DEFAULT + 1, waiter_thread_func, &lock);
+  msg ("This thread should have priority %d.  Actual priority: %d.",
+       PRI_DEFAULT + 1, thread_get_priority ());
+  timer_sleep (20);
+  msg ("This thread should have priority %d.  Actual priority: %d.",
+       PRI_DEFAULT, thread_get_priority ());
+  lock_release (&lock);
+
+  sema_init (&sema, 0);
+  if (sema_down_timeout (&sema, 10))
+    fail ("sema_down_timeout() succeeded on a semaphore of value 0");
+  msg ("sema_down_timeout() timed out.");
+  thread_create ("upper", PRI_DEFAULT - 1, upper_thread_func, &sema);
+  if (!sema_down_timeout (&sema, 1000))
+    fail ("sema_down_timeout() timed out despite sema_up()");
+  msg ("sema_down_timeout() succeeded.");
+}
+
+static void
+waiter_thread_func (void *lock_) 
+{
+  struct lock *lock = lock_;
+
+  if (lock_acquire_timeout (lock, 10))
+    fail ("waiter: got the lock");
+  msg ("waiter: timed out");
+}
+
+static void
+upper_thread_func (void *sema_) 
+{
+  struct semaphore *sema = sema_;
+
+  msg ("upper: sema_up");
+  sema_up (sema);
+}
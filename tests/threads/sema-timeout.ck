@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(sema-timeout) begin
+(sema-timeout) This thread should have priority 32.  Actual priority: 32.
+(sema-timeout) waiter: timed out
+(sema-timeout) This thread should have priority 31.  Actual priority: 31.
+(sema-timeout) sema_down_timeout() timed out.
+(sema-timeout) upper: sema_up
+(sema-timeout) sema_down_timeout() succeeded.
+(sema-timeout) end
+EOF
+pass;
@@ -29,6 +29,11 @@ static const struct test tests[] =
     {"priority-preempt", test_priority_preempt},
     {"priority-sema", test_priority_sema},
     {"priority-condvar", test_priority_condvar},
+    {"sema-timeout", test_sema_timeout},
+    {"palloc-coalesce", test_palloc_coalesce},
+    {"malloc-realloc", test_malloc_realloc},
+    {"malloc-exhaust", test_malloc_exhaust},
+    {"workqueue", test_workqueue},
     {"mlfqs-load-1", test_mlfqs_load_1},
     {"mlfqs-load-60", test_mlfqs_load_60},
     {"mlfqs-load-avg", test_mlfqs_load_avg},
@@ -38,6 +43,8 @@ static const struct test tests[] =
     {"mlfqs-nice-2", test_mlfqs_nice_2},
     {"mlfqs-nice-10", test_mlfqs_nice_10},
     {"mlfqs-block", test_mlfqs_block},
+    {"thread-create-bench", test_thread_create_bench},
+    {"malloc-bench", test_malloc_bench},
   };
 
 static const char *test_name;
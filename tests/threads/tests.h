@@ -23,6 +23,11 @@ extern test_func test_priority_fifo;
 extern test_func test_priority_preempt;
 extern test_func test_priority_sema;
 extern test_func test_priority_condvar;
+extern test_func test_sema_timeout;
+extern test_func test_palloc_coalesce;
+extern test_func test_malloc_realloc;
+extern test_func test_malloc_exhaust;
+extern test_func test_workqueue;
 extern test_func test_mlfqs_load_1;
 extern test_func test_mlfqs_load_60;
 extern test_func test_mlfqs_load_avg;
@@ -32,6 +37,8 @@ extern test_func test_mlfqs_fair_20;
 extern test_func test_mlfqs_nice_2;
 extern test_func test_mlfqs_nice_10;
 extern test_func test_mlfqs_block;
+extern test_func test_thread_create_bench;
+extern test_func test_malloc_bench;
 
 void msg (const char *, ...);
 void fail (const char *, ...);
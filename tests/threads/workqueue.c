@@ -0,0 +1,191 @@
+/* Checks work queues and timer events.
+
+   Several threads post work items to a work queue whose workers
+   have lower priority than they do, so that each item is still
+   queued when its poster tries to post it again, which must
+   fail.  Every item must run exactly once per successful post.
+   Delayed work may not be posted again while it waits, either.
+
+   Then timer events are scheduled out of order, with deadlines
+   on both sides of the timer wheel's first level, and must fire
+   in order of deadline, no earlier than their deadlines.  A
+   cancelled event must not fire at all. */
+
+#include <stdio.h>
+#include "tests/threads/tests.h"
+#include "threads/init.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/workqueue.h"
+#include "devices/timer.h"
+
+#define POSTER_CNT 4            /* Number of posting threads. */
+#define POST_CNT 10             /* Posts per thread. */
+#define EVENT_CNT 6             /* Number of timer events. */
+
+/* A posting thread and its work item. */
+struct poster
+  {
+    struct work work;           /* Work item it posts. */
+    struct semaphore done;      /* Upped each time the work runs. */
+    int run_cnt;                /* Times the work has run. */
+  };
+
+/* A timer event and when it should and did fire. */
+struct event
+  {
+    struct timer_event timer;   /* The timer event. */
+    int64_t deadline;           /* Ticks after start to fire. */
+    int64_t fired;              /* Tick when it fired. */
+  };
+
+static struct workqueue wq;
+static struct semaphore posters_done;
+static work_func poster_work;
+static work_func unused_work;
+static thread_func poster_thread;
+
+static const int64_t deadlines[EVENT_CNT] = {300, 10, 257, 50, 255, 520};
+static struct event *fired_events[EVENT_CNT];
+static size_t fired_cnt;
+static struct semaphore events_done;
+static timer_event_func event_func;
+
+void
+test_workqueue (void)
+{
+  static struct poster posters[POSTER_CNT];
+  static struct event events[EVENT_CNT];
+  struct timer_event cancelled;
+  struct work delayed;
+  int64_t start;
+  size_t i;
+
+  /* This test does not work with the MLFQS. */
+  ASSERT (!thread_mlfqs);
+
+  /* Make sure our priority is the default. */
+  ASSERT (thread_get_priority () == PRI_DEFAULT);
+
+  if (!workqueue_create (&wq, "wqtest", 2, 16, PRI_DEFAULT - 1))
+    fail ("workqueue_create() failed");
+
+  sema_init (&posters_done, 0);
+  for (i = 0; i < POSTER_CNT; i++)
+    {
+      struct poster *p = &posters[i];
+      char name[16];
+
+      work_init (&p->work, poster_work, p);
+      sema_init (&p->done, 0);
+      p->run_cnt = 0;
+      snprintf (name, sizeof name, "poster %zu", i);
+      thread_create (name, PRI_DEFAULT, poster_thread, p);
+    }
+  for (i = 0; i < POSTER_CNT; i++)
+    sema_down (&posters_done);
+  workqueue_flush (&wq);
+
+  for (i = 0; i < POSTER_CNT; i++)
+    if (posters[i].run_cnt != POST_CNT)
+      fail ("work of poster %zu ran %d times, expected %d",
+            i, posters[i].run_cnt, POST_CNT);
+  msg ("%d threads' work ran %d times each.", POSTER_CNT, POST_CNT);
+
+  work_init (&delayed, unused_work, NULL);
+  if (!work_post_delayed (&wq, &delayed, 1000))
+    fail ("work_post_delayed() failed");
+  if (work_post (&wq, &delayed))
+    fail ("work_post() accepted delayed work");
+  if (!work_cancel (&delayed))
+    fail ("work_cancel() failed on delayed work");
+  msg ("Delayed work could not be re-posted.");
+
+  sema_init (&events_done, 0);
+  fired_cnt = 0;
+  timer_event_init (&cancelled, event_func, NULL);
+  start = timer_ticks ();
+  for (i = 0; i < EVENT_CNT; i++)
+    {
+      struct event *e = &events[i];
+
+      e->deadline = deadlines[i];
+      timer_event_init (&e->timer, event_func, e);
+      if (!timer_event_schedule (&e->timer, e->deadline))
+        fail ("timer_event_schedule() failed");
+    }
+  if (timer_event_schedule (&events[0].timer, 1))
+    fail ("timer_event_schedule() accepted a pending event");
+  if (!timer_event_schedule (&cancelled, 100)
+      || !timer_event_cancel (&cancelled))
+    fail ("could not schedule and cancel an event");
+
+  for (i = 0; i < EVENT_CNT; i++)
+    sema_down (&events_done);
+  for (i = 0; i < EVENT_CNT; i++)
+    {
+      struct event *e = fired_events[i];
+
+      if (e == NULL)
+        fail ("cancelled event fired");
+      if (i > 0 && e->deadline < fired_events[i - 1]->deadline)
+        fail ("event due at %lld fired after one due at %lld",
+              e->deadline, fired_events[i - 1]->deadline);
+      if (e->fired < start + e->deadline)
+        fail ("event due at %lld fired at %lld",
+              e->deadline, e->fired - start);
+      msg ("Event due at %lld fired.", e->deadline);
+    }
+  if (fired_cnt != EVENT_CNT)
+    fail ("%zu events fired, expected %d", fired_cnt, EVENT_CNT);
+}
+
+/* Posts its work item POST_CNT times, trying each time to post
+   it a second time while it is still queued. */
+static void
+poster_thread (void *p_)
+{
+  struct poster *p = p_;
+  int i;
+
+  for (i = 0; i < POST_CNT; i++)
+    {
+      if (!work_post (&wq, &p->work))
+        fail ("work_post() failed on idle work");
+      if (work_post (&wq, &p->work))
+        fail ("work_post() accepted queued work");
+      sema_down (&p->done);
+    }
+  sema_up (&posters_done);
+}
+
+/* Work item function for posting thread P_. */
+static void
+poster_work (void *p_)
+{
+  struct poster *p = p_;
+
+  p->run_cnt++;
+  sema_up (&p->done);
+}
+
+/* Work item function that must never run. */
+static void
+unused_work (void *aux UNUSED)
+{
+  fail ("cancelled work ran");
+}
+
+/* Timer event function, called from the timer interrupt. */
+static void
+event_func (void *e_)
+{
+  struct event *e = e_;
+
+  if (e != NULL)
+    e->fired = timer_ticks ();
+  if (fired_cnt < EVENT_CNT)
+    fired_events[fired_cnt] = e;
+  fired_cnt++;
+  sema_up (&events_done);
+}
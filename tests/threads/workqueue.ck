@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(workqueue) begin
+(workqueue) 4 threads' work ran 10 times each.
+(workqueue) Delayed work could not be re-posted.
+(workqueue) Event due at 10 fired.
+(workqueue) Event due at 50 fired.
+(workqueue) Event due at 255 fired.
+(workqueue) Event due at 257 fired.
+(workqueue) Event due at 300 fired.
+(workqueue) Event due at 520 fired.
+(workqueue) end
+EOF
+pass;
@@ -0,0 +1,586 @@
+#include "threads/cpu.h"
+#include <debug.h>
+#include <inttypes.h>
+#include <packed.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/ioapic.h"
+#include "devices/lapic.h"
+#include "devices/timer.h"
+#include "threads/init.h"
+#include "threads/interrupt.h"
+#include "threads/io.h"
+#include "threads/loader.h"
+#include "threads/palloc.h"
+#include "threads/pte.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#ifdef USERPROG
+#include "userprog/gdt.h"
+#endif
+
+/* Multiprocessor support.
+
+   At boot, only the bootstrap processor (BSP) runs.  cpu_init()
+   finds the other CPUs, the application processors (APs), in
+   the MultiProcessor Specification configuration table that the
+   BIOS provides.  Once the kernel is otherwise initialized,
+   cpu_start() switches interrupt delivery from the 8259A PICs
+   to the I/O APIC, which delivers all device interrupts to the
+   BSP, and then starts the APs one at a time.  Each AP begins
+   in real mode in the code in cpu-start.S, which switches to
+   protected mode and calls cpu_ap_main(), which then goes idle
+   until the scheduler gives it a thread to run.
+
+   Refer to [MPS] for the configuration table, and to [IA32-v3a]
+   chapter 8 "Multiple-Processor Management" for the startup
+   sequence. */
+
+/* CPUs. */
+struct cpu cpus[CPU_MAX];
+int cpu_cnt = 1;
+bool cpu_smp;
+int cpu_limit = CPU_MAX;
+
+/* Physical address to which cpu_start() copies the AP startup
+   code.  The startup IPI can only address a page below 1 MB, and
+   this one is not used by the loader, the kernel, or its initial
+   page tables. */
+#define CPU_AP_PADDR 0x8000
+
+/* AP startup code and the data that cpu_start() fills in, in
+   cpu-start.S. */
+extern char cpu_start_ap[], cpu_start_ap_end[];
+extern char cpu_ap_gdtr[], cpu_ap_cr3[], cpu_ap_cr4[];
+
+/* Top of the stack for the AP that is starting, which is the
+   stack of its idle thread.  Read by cpu-start.S. */
+uint8_t *cpu_ap_stack;
+
+/* MP floating pointer structure, which the BIOS puts in one of
+   the areas that mp_find() searches.  See [MPS] 4.1. */
+struct mp_float
+  {
+    char signature[4];          /* "_MP_". */
+    uint32_t conf_paddr;        /* Physical address of mp_conf. */
+    uint8_t length;             /* Length in 16-byte units. */
+    uint8_t spec_rev;           /* MP specification revision. */
+    uint8_t checksum;           /* All bytes sum to 0. */
+    uint8_t type;               /* Default configuration, or 0. */
+    uint8_t imcr;               /* Bit 7: IMCR present. */
+    uint8_t reserved[3];
+  }
+PACKED;
+
+/* MP configuration table header, followed by entries, each of
+   which begins with a type byte.  See [MPS] 4.2. */
+struct mp_conf
+  {
+    char signature[4];          /* "PCMP". */
+    uint16_t length;            /* Length of header and entries. */
+    uint8_t spec_rev;           /* MP specification revision. */
+    uint8_t checksum;           /* All bytes sum to 0. */
+    char oem_id[8];
+    char product_id[12];
+    uint32_t oem_table_paddr;
+    uint16_t oem_table_size;
+    uint16_t entry_cnt;         /* Number of entries. */
+    uint32_t lapic_paddr;       /* Physical address of local APICs. */
+    uint16_t ext_length;
+    uint8_t ext_checksum;
+    uint8_t reserved;
+  }
+PACKED;
+
+/* Types of MP configuration table entries. */
+enum mp_entry_type
+  {
+    MP_PROCESSOR = 0,           /* A CPU. */
+    MP_BUS = 1,                 /* A bus. */
+    MP_IOAPIC = 2,              /* An I/O APIC. */
+    MP_IOINTR = 3,              /* I/O interrupt assignment. */
+    MP_LINTR = 4                /* Local interrupt assignment. */
+  };
+
+/* MP_PROCESSOR entry.  See [MPS] 4.3.1. */
+struct mp_processor
+  {
+    uint8_t type;               /* MP_PROCESSOR. */
+    uint8_t apic_id;            /* Local APIC ID. */
+    uint8_t apic_ver;           /* Local APIC version. */
+    uint8_t flags;              /* MP_PROC_*. */
+    uint32_t signature;         /* CPUID signature. */
+    uint32_t features;          /* CPUID feature flags. */
+    uint8_t reserved[8];
+  }
+PACKED;
+
+#define MP_PROC_ENABLED 0x01    /* Usable. */
+#define MP_PROC_BSP     0x02    /* Bootstrap processor. */
+
+/* MP_BUS entry.  See [MPS] 4.3.2. */
+struct mp_bus
+  {
+    uint8_t type;               /* MP_BUS. */
+    uint8_t bus_id;             /* Bus ID. */
+    char bus_type[6];           /* e.g. "ISA   ", space-padded. */
+  }
+PACKED;
+
+/* MP_IOAPIC entry.  See [MPS] 4.3.3. */
+struct mp_ioapic
+  {
+    uint8_t type;               /* MP_IOAPIC. */
+    uint8_t apic_id;            /* I/O APIC ID. */
+    uint8_t apic_ver;           /* I/O APIC version. */
+    uint8_t flags;              /* Bit 0: usable. */
+    uint32_t paddr;             /* Physical address of registers. */
+  }
+PACKED;
+
+/* MP_IOINTR and MP_LINTR entries.  See [MPS] 4.3.4. */
+struct mp_intr
+  {
+    uint8_t type;               /* MP_IOINTR or MP_LINTR. */
+    uint8_t intr_type;          /* 0: vectored interrupt. */
+    uint16_t flags;             /* Polarity and trigger mode. */
+    uint8_t src_bus;            /* Source bus ID. */
+    uint8_t src_irq;            /* IRQ on source bus. */
+    uint8_t dst_apic_id;        /* Destination APIC ID. */
+    uint8_t dst_pin;            /* Destination APIC input pin. */
+  }
+PACKED;
+
+/* Polarity and trigger mode in mp_intr's flags, where 0 means
+   that the bus's default applies, which for ISA is active high
+   and edge triggered. */
+#define MP_INTR_POLARITY(FLAGS) ((FLAGS) & 3)
+#define MP_INTR_TRIGGER(FLAGS) (((FLAGS) >> 2) & 3)
+#define MP_INTR_ACTIVE_LOW 3
+#define MP_INTR_LEVEL 3
+
+/* What cpu_init() found.  CPUs found are in cpus[], which
+   cpu_start() starts, and only the first I/O APIC is used. */
+static int cpu_found = 1;               /* Number of CPUs in cpus[]. */
+static uintptr_t ioapic_paddr;          /* I/O APIC, or 0 if none. */
+static bool imcr_present;               /* Start in PIC mode? */
+
+/* I/O APIC input pin and mp_intr flags for each ISA IRQ. */
+#define ISA_IRQ_CNT 16
+static uint8_t isa_pins[ISA_IRQ_CNT];
+static uint16_t isa_flags[ISA_IRQ_CNT];
+
+void cpu_ap_main (void) NO_RETURN;
+static struct mp_float *mp_find (void);
+static struct mp_float *mp_search (uintptr_t paddr, size_t size);
+static bool mp_parse (struct mp_conf *);
+static uint8_t checksum (const void *, size_t);
+static bool map_mmio (uintptr_t paddr);
+static bool is_ram (uintptr_t paddr, size_t size);
+static intr_handler_func reschedule_interrupt, tick_interrupt;
+
+/* Finds the CPUs and I/O APIC described by the BIOS's MP
+   configuration table, if it has one, and maps the local and I/O
+   APICs' registers into the kernel's page directory.  This must
+   happen before the first process's page directory is created,
+   since those copy the kernel mappings.  Does not start any
+   CPU. */
+void
+cpu_init (void)
+{
+  struct mp_float *mp;
+  struct mp_conf *conf;
+  int i;
+
+  cpus[0].id = 0;
+  for (i = 0; i < ISA_IRQ_CNT; i++)
+    isa_pins[i] = i;
+
+  mp = mp_find ();
+  if (mp == NULL)
+    return;
+  if (mp->type != 0 || mp->conf_paddr == 0)
+    {
+      printf ("cpu_init: default MP configurations not supported\n");
+      return;
+    }
+  if (!is_ram (mp->conf_paddr, sizeof *conf))
+    return;
+  conf = ptov (mp->conf_paddr);
+  if (memcmp (conf->signature, "PCMP", 4)
+      || !is_ram (mp->conf_paddr, conf->length)
+      || checksum (conf, conf->length) != 0)
+    {
+      printf ("cpu_init: bad MP configuration table\n");
+      return;
+    }
+  imcr_present = (mp->imcr & 0x80) != 0;
+
+  if (!map_mmio (conf->lapic_paddr))
+    {
+      printf ("cpu_init: cannot map local APIC at %#"PRIx32"\n",
+              conf->lapic_paddr);
+      return;
+    }
+  lapic_set_regs ((volatile void *) conf->lapic_paddr);
+  cpus[0].apic_id = lapic_id ();
+
+  if (!mp_parse (conf))
+    {
+      printf ("cpu_init: bad MP configuration table entry\n");
+      cpu_found = 1;
+      ioapic_paddr = 0;
+      return;
+    }
+  if (ioapic_paddr != 0 && !map_mmio (ioapic_paddr))
+    {
+      printf ("cpu_init: cannot map I/O APIC at %#"PRIxPTR"\n",
+              ioapic_paddr);
+      ioapic_paddr = 0;
+    }
+}
+
+/* Starts the application processors that cpu_init() found,
+   routing device interrupts through the I/O APIC first.  Does
+   nothing if cpu_init() found only one CPU, or no I/O APIC.
+   Must be called with interrupts on, after the timer has been
+   calibrated. */
+void
+cpu_start (void)
+{
+  struct
+    {
+      uint16_t limit;
+      uint32_t base;
+    }
+  PACKED gdtr;
+  enum intr_level old_level;
+  uint8_t *start;
+  uint32_t *pd;
+  uint32_t cr4;
+  int irq;
+  int i;
+
+  ASSERT (intr_get_level () == INTR_ON);
+
+  if (cpu_found < 2 || ioapic_paddr == 0)
+    return;
+
+  /* Route device interrupts to the BSP through the I/O APIC.
+     With an IMCR, the chipset starts out connecting the PICs
+     straight to the BSP, so switch it to the APIC. */
+  old_level = intr_disable ();
+  intr_use_apic ();
+  if (imcr_present)
+    {
+      outb (0x22, 0x70);
+      outb (0x23, inb (0x23) | 1);
+    }
+  ioapic_init ((volatile void *) ioapic_paddr);
+  for (irq = 0; irq < ISA_IRQ_CNT; irq++)
+    if (irq != 2 && isa_pins[irq] < ioapic_pin_cnt ())
+      ioapic_route (isa_pins[irq], 0x20 + irq, cpus[0].apic_id,
+                    MP_INTR_POLARITY (isa_flags[irq]) == MP_INTR_ACTIVE_LOW,
+                    MP_INTR_TRIGGER (isa_flags[irq]) == MP_INTR_LEVEL);
+  lapic_init ();
+  intr_register_ipi (CPU_VEC_RESCHEDULE, reschedule_interrupt,
+                     "Reschedule IPI");
+  intr_register_ipi (CPU_VEC_TICK, tick_interrupt, "Timer Tick IPI");
+  intr_set_level (old_level);
+
+  /* The APs start with paging off, so they need a page directory
+     that maps the startup code at its physical address as well
+     as the kernel at its virtual address. */
+  pd = palloc_get_page (0);
+  if (pd == NULL)
+    {
+      printf ("cpu_start: out of memory\n");
+      return;
+    }
+  memcpy (pd, init_page_dir, PGSIZE);
+  pd[0] = init_page_dir[pd_no (ptov (CPU_AP_PADDR))];
+
+  /* Copy the startup code and fill in its data. */
+  start = ptov (CPU_AP_PADDR);
+  memcpy (start, cpu_start_ap, cpu_start_ap_end - cpu_start_ap);
+  asm volatile ("sgdt %0" : "=m" (gdtr));
+  memcpy (start + (cpu_ap_gdtr - cpu_start_ap), &gdtr, sizeof gdtr);
+  *(uint32_t *) (start + (cpu_ap_cr3 - cpu_start_ap)) = vtop (pd);
+  asm volatile ("movl %%cr4, %0" : "=r" (cr4));
+  *(uint32_t *) (start + (cpu_ap_cr4 - cpu_start_ap)) = cr4;
+
+  /* From here on, intr_disable() must exclude the other CPUs. */
+  cpu_smp = true;
+
+  /* Start the APs one at a time, since they share the startup
+     code and cpu_ap_stack.  Each gets 100 ms. */
+  for (i = 1; i < cpu_found; i++)
+    {
+      struct cpu *c = &cpus[i];
+      struct thread *idle = thread_create_idle (c);
+      int ms;
+
+      if (idle == NULL)
+        {
+          printf ("cpu_start: out of memory\n");
+          break;
+        }
+      cpu_ap_stack = (uint8_t *) idle + PGSIZE;
+      lapic_start_ap (c->apic_id, CPU_AP_PADDR);
+      for (ms = 0; ms < 100 && !c->started; ms++)
+        timer_mdelay (1);
+      if (!c->started)
+        {
+          printf ("cpu_start: CPU %d (APIC ID %d) did not start\n",
+                  i, c->apic_id);
+          break;
+        }
+    }
+
+  palloc_free_page (pd);
+  printf ("cpu_start: %d CPUs running\n", cpu_cnt);
+}
+
+/* Returns the CPU that is running the caller. */
+struct cpu *
+cpu_current (void)
+{
+  uintptr_t esp;
+
+  if (!cpu_smp)
+    return &cpus[0];
+
+  /* Each CPU always runs on the stack of its running thread, and
+     a thread's CPU changes only while it is not running. */
+  asm ("mov %%esp, %0" : "=g" (esp));
+  return ((struct thread *) pg_round_down ((void *) esp))->cpu;
+}
+
+/* Sends CPU C, which must not be the current CPU, an IPI that
+   makes it check whether to preempt the thread it is running.
+   Interrupts must be off. */
+void
+cpu_send_reschedule (struct cpu *c)
+{
+  ASSERT (c != cpu_current ());
+  lapic_send_ipi (c->apic_id, CPU_VEC_RESCHEDULE);
+}
+
+/* Forwards a timer tick from the BSP, which receives the timer
+   interrupt, to the APs.  Interrupts must be off. */
+void
+cpu_tick_others (void)
+{
+  int i;
+
+  ASSERT (cpu_current () == &cpus[0]);
+
+  for (i = 1; i < cpu_cnt; i++)
+    lapic_send_ipi (cpus[i].apic_id, CPU_VEC_TICK);
+}
+
+/* Called by cpu-start.S on an AP, with interrupts off, on the
+   stack of the AP's idle thread, which is also the AP's running
+   thread as far as cpu_current() is concerned. */
+void
+cpu_ap_main (void)
+{
+  struct cpu *c = cpu_current ();
+
+  intr_disable ();
+
+  /* Switch from the temporary page directory, so that cpu_start()
+     can free it. */
+  asm volatile ("movl %0, %%cr3" : : "r" (vtop (init_page_dir)) : "memory");
+
+  intr_init_ap ();
+#ifdef USERPROG
+  gdt_init_ap (c->id);
+#endif
+  lapic_init ();
+
+  spinlock_acquire (&sched_lock);
+  ASSERT (cpu_cnt == c->id);
+  cpu_cnt++;
+  c->started = true;
+  spinlock_release (&sched_lock);
+
+  thread_start_ap ();
+}
+
+/* Looks for the MP floating pointer structure in the areas where
+   [MPS] 4 says the BIOS may put it: the first kB of the extended
+   BIOS data area, the last kB of base memory, and the BIOS ROM.
+   Returns it, or a null pointer if it is not found. */
+static struct mp_float *
+mp_find (void)
+{
+  uintptr_t ebda = *(uint16_t *) ptov (0x40e) << 4;
+  uintptr_t base_kb = *(uint16_t *) ptov (0x413);
+  struct mp_float *mp = NULL;
+
+  if (ebda != 0)
+    mp = mp_search (ebda, 1024);
+  if (mp == NULL && base_kb > 0)
+    mp = mp_search (base_kb * 1024 - 1024, 1024);
+  if (mp == NULL)
+    mp = mp_search (0xf0000, 0x10000);
+  return mp;
+}
+
+/* Searches SIZE bytes of physical memory starting at PADDR for
+   the MP floating pointer structure. */
+static struct mp_float *
+mp_search (uintptr_t paddr, size_t size)
+{
+  uint8_t *p, *end;
+
+  if (!is_ram (paddr, size))
+    return NULL;
+  p = ptov (paddr);
+  end = p + size;
+  for (; p + sizeof (struct mp_float) <= end; p += 16)
+    if (!memcmp (p, "_MP_", 4) && checksum (p, sizeof (struct mp_float)) == 0)
+      return (struct mp_float *) p;
+  return NULL;
+}
+
+/* Records the CPUs, the first usable I/O APIC, and the ISA IRQs'
+   I/O APIC pins from the entries in CONF, which follow it.
+   Returns false if an entry is not understood, since its size is
+   then not known either. */
+static bool
+mp_parse (struct mp_conf *conf)
+{
+  uint8_t *p = (uint8_t *) (conf + 1);
+  uint8_t *end = (uint8_t *) conf + conf->length;
+  int isa_bus = -1;
+  int ioapic_id = -1;
+
+  while (p < end)
+    switch (*p)
+      {
+      case MP_PROCESSOR:
+        {
+          struct mp_processor *proc = (struct mp_processor *) p;
+          if ((proc->flags & MP_PROC_ENABLED)
+              && !(proc->flags & MP_PROC_BSP)
+              && cpu_found < cpu_limit && cpu_found < CPU_MAX)
+            {
+              cpus[cpu_found].id = cpu_found;
+              cpus[cpu_found].apic_id = proc->apic_id;
+              cpu_found++;
+            }
+          p += sizeof *proc;
+        }
+        break;
+
+      case MP_BUS:
+        {
+          struct mp_bus *bus = (struct mp_bus *) p;
+          if (!memcmp (bus->bus_type, "ISA", 3))
+            isa_bus = bus->bus_id;
+          p += sizeof *bus;
+        }
+        break;
+
+      case MP_IOAPIC:
+        {
+          struct mp_ioapic *ioapic = (struct mp_ioapic *) p;
+          if ((ioapic->flags & 1) && ioapic_paddr == 0)
+            {
+              ioapic_paddr = ioapic->paddr;
+              ioapic_id = ioapic->apic_id;
+            }
+          p += sizeof *ioapic;
+        }
+        break;
+
+      case MP_IOINTR:
+        {
+          struct mp_intr *intr = (struct mp_intr *) p;
+          if (intr->intr_type == 0
+              && intr->src_bus == isa_bus
+              && intr->src_irq < ISA_IRQ_CNT
+              && (intr->dst_apic_id == ioapic_id
+                  || intr->dst_apic_id == 0xff))
+            {
+              isa_pins[intr->src_irq] = intr->dst_pin;
+              isa_flags[intr->src_irq] = intr->flags;
+            }
+          p += sizeof *intr;
+        }
+        break;
+
+      case MP_LINTR:
+        p += sizeof (struct mp_intr);
+        break;
+
+      default:
+        return false;
+      }
+  return true;
+}
+
+/* Returns the sum of the SIZE bytes at P, which is 0 for a valid
+   MP structure. */
+static uint8_t
+checksum (const void *p_, size_t size)
+{
+  const uint8_t *p = p_;
+  uint8_t sum = 0;
+
+  while (size-- > 0)
+    sum += *p++;
+  return sum;
+}
+
+/* Maps the page of memory-mapped device registers at physical
+   address PADDR into init_page_dir, at the same virtual address,
+   with caching disabled.  Returns false if that address is not
+   free for the purpose or if memory is short. */
+static bool
+map_mmio (uintptr_t paddr)
+{
+  void *vaddr = (void *) paddr;
+  uint32_t *pd = init_page_dir;
+  uint32_t *pt;
+
+  if (paddr < LOADER_PHYS_BASE + init_ram_pages * PGSIZE)
+    return false;
+
+  if (pd[pd_no (vaddr)] == 0)
+    {
+      pt = palloc_get_page (PAL_ZERO);
+      if (pt == NULL)
+        return false;
+      pd[pd_no (vaddr)] = pde_create (pt);
+    }
+  pt = pde_get_pt (pd[pd_no (vaddr)]);
+  pt[pt_no (vaddr)] = (paddr & PTE_ADDR) | PTE_P | PTE_W | PTE_PCD | PTE_PWT;
+  return true;
+}
+
+/* Returns true if the SIZE bytes at physical address PADDR are
+   within RAM, which the kernel maps. */
+static bool
+is_ram (uintptr_t paddr, size_t size)
+{
+  uintptr_t ram_size = init_ram_pages * PGSIZE;
+  return paddr < ram_size && size <= ram_size - paddr;
+}
+
+/* Reschedule IPI handler. */
+static void
+reschedule_interrupt (struct intr_frame *f UNUSED)
+{
+  thread_preempt ();
+}
+
+/* Timer tick IPI handler. */
+static void
+tick_interrupt (struct intr_frame *f UNUSED)
+{
+  thread_tick ();
+}
@@ -0,0 +1,75 @@
+#ifndef THREADS_CPU_H
+#define THREADS_CPU_H
+
+#include <list.h>
+#include <round.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "threads/thread.h"
+
+/* Maximum number of CPUs. */
+#define CPU_MAX 8
+
+/* Interrupt vectors for interprocessor interrupts (IPIs). */
+#define CPU_VEC_RESCHEDULE 0xf0 /* Check the run queue for preemption. */
+#define CPU_VEC_TICK 0xf1       /* Timer tick, forwarded by the BSP. */
+
+/* A CPU.
+
+   cpus[0] is the bootstrap processor (BSP), the one that runs
+   main().  The others are application processors (APs), which
+   cpu_start() starts once the kernel is otherwise initialized.
+   The CPUs that are running are always cpus[0] through
+   cpus[cpu_cnt - 1].
+
+   Each CPU schedules threads from its own run queue, protected,
+   like everything else in the scheduler, by sched_lock (see
+   thread.h). */
+struct cpu
+  {
+    /* Owned by cpu.c. */
+    int id;                             /* Index in cpus[]. */
+    uint8_t apic_id;                    /* Local APIC ID. */
+    volatile bool started;              /* Has the CPU started? */
+
+    /* Owned by thread.c. */
+    struct thread *idle_thread;         /* Runs when nothing else can. */
+    struct thread *running;             /* Running thread. */
+    struct list ready_lists[PRI_CNT];   /* Run queue, one FIFO per priority. */
+    uint32_t ready_map[DIV_ROUND_UP (PRI_CNT, 32)]; /* Nonempty lists. */
+    int ready_cnt;                      /* Number of threads in run queue. */
+    unsigned thread_ticks;              /* # of timer ticks since last yield. */
+    bool preempting;                    /* Is the running thread preempted? */
+    uint64_t switch_ns;                 /* When the running thread started. */
+    long long idle_ticks;               /* # of timer ticks spent idle. */
+    long long kernel_ticks;             /* # of timer ticks in kernel threads. */
+    long long user_ticks;               /* # of timer ticks in user programs. */
+    uint64_t idle_ns;                   /* Nanoseconds spent idle. */
+    uint64_t kernel_ns;                 /* Nanoseconds in kernel threads. */
+    uint64_t user_ns;                   /* Nanoseconds in user programs. */
+    long long steal_cnt;                /* # of threads stolen from peers. */
+    long long migrate_cnt;              /* # of threads it moved between CPUs. */
+
+    /* Owned by interrupt.c. */
+    bool in_external_intr;              /* Processing an external interrupt? */
+    bool yield_on_return;               /* Yield on interrupt return? */
+  };
+
+extern struct cpu cpus[CPU_MAX];
+extern int cpu_cnt;
+
+/* True once more than one CPU may be running, which is when
+   intr_disable() starts taking the interrupt lock. */
+extern bool cpu_smp;
+
+/* Maximum number of CPUs to start.
+   Controlled by kernel command-line option "-cpus=N". */
+extern int cpu_limit;
+
+void cpu_init (void);
+void cpu_start (void);
+struct cpu *cpu_current (void);
+void cpu_send_reschedule (struct cpu *);
+void cpu_tick_others (void);
+
+#endif /* threads/cpu.h */
@@ -0,0 +1,76 @@
+#ifndef THREADS_FIXED_POINT_H
+#define THREADS_FIXED_POINT_H
+
+#include <stdint.h>
+
+/* Fixed-point real arithmetic.
+
+   The kernel does not use the floating-point unit, so real
+   quantities such as the MLFQS load average are represented as
+   32-bit signed integers in 17.14 format: the low FP_SHIFT bits
+   hold the fraction and the remaining bits hold the integer
+   part, so the largest representable value is about 131,071.99.
+
+   Sums and differences of two fixed-point numbers, and products
+   and quotients of a fixed-point number and an integer, are
+   ordinary integer operations.  Products and quotients of two
+   fixed-point numbers need an extra scaling step, done in 64 bits
+   to avoid overflowing the intermediate result. */
+typedef int32_t fixed_point;
+
+/* Number of fraction bits. */
+#define FP_SHIFT 14
+
+/* The fixed-point representation of 1. */
+#define FP_ONE (1 << FP_SHIFT)
+
+/* Converts integer N to fixed point. */
+static inline fixed_point
+fp_from_int (int n)
+{
+  return n * FP_ONE;
+}
+
+/* Converts X to an integer, rounding toward zero. */
+static inline int
+fp_trunc (fixed_point x)
+{
+  return x / FP_ONE;
+}
+
+/* Converts X to an integer, rounding to nearest. */
+static inline int
+fp_round (fixed_point x)
+{
+  return x >= 0 ? (x + FP_ONE / 2) / FP_ONE : (x - FP_ONE / 2) / FP_ONE;
+}
+
+/* Returns X + N, for integer N. */
+static inline fixed_point
+fp_add_int (fixed_point x, int n)
+{
+  return x + n * FP_ONE;
+}
+
+/* Returns X - N, for integer N. */
+static inline fixed_point
+fp_sub_int (fixed_point x, int n)
+{
+  return x - n * FP_ONE;
+}
+
+/* Returns X * Y. */
+static inline fixed_point
+fp_mul (fixed_point x, fixed_point y)
+{
+  return ((int64_t) x) * y / FP_ONE;
+}
+
+/* Returns X / Y. */
+static inline fixed_point
+fp_div (fixed_point x, fixed_point y)
+{
+  return ((int64_t) x) * FP_ONE / y;
+}
+
+#endif /* threads/fixed-point.h */
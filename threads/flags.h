@@ -5,4 +5,33 @@
 #define FLAG_MBS  0x00000002    /* Must be set. */
 #define FLAG_IF   0x00000200    /* Interrupt Flag. */
 
+/* CR0 Register. */
+#define CR0_PE    0x00000001    /* Protection Enable. */
+#define CR0_EM    0x00000004    /* (Floating-point) Emulation. */
+#define CR0_WP    0x00010000    /* Write-Protect enable in kernel mode. */
+#define CR0_PG    0x80000000    /* Paging. */
+
+/* CR4 Register. */
+#define CR4_PSE   0x00000010    /* Page Size Extensions (4 MB pages). */
+
+/* CPUID leaf 1 feature flags in EDX. */
+#define CPUID_PSE 0x00000008    /* Page Size Extensions. */
+
+#ifndef __ASSEMBLER__
+#include <stdint.h>
+
+/* Executes CPUID for LEAF and returns the EDX register, which
+   for leaf 1 holds the feature flags above.  See [IA32-v2a]
+   "CPUID--CPU Identification". */
+static inline uint32_t
+cpuid_edx (uint32_t leaf) 
+{
+  uint32_t eax, ebx, ecx, edx;
+  asm volatile ("cpuid"
+                : "=a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx)
+                : "a" (leaf), "c" (0));
+  return edx;
+}
+#endif
+
 #endif /* threads/flags.h */
@@ -8,6 +8,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include "devices/clock.h"
 #include "devices/kbd.h"
 #include "devices/input.h"
 #include "devices/serial.h"
@@ -15,17 +16,21 @@
 #include "devices/timer.h"
 #include "devices/vga.h"
 #include "devices/rtc.h"
+#include "threads/cpu.h"
+#include "threads/flags.h"
 #include "threads/interrupt.h"
 #include "threads/io.h"
 #include "threads/loader.h"
 #include "threads/malloc.h"
 #include "threads/palloc.h"
 #include "threads/pte.h"
+#include "threads/synch.h"
 #include "threads/thread.h"
 #ifdef USERPROG
 #include "userprog/process.h"
 #include "userprog/exception.h"
 #include "userprog/gdt.h"
+#include "userprog/pagedir.h"
 #include "userprog/syscall.h"
 #include "userprog/tss.h"
 #else
@@ -57,6 +62,28 @@ static const char *swap_bdev_name;
 /* -ul: Maximum number of pages to put into palloc's user pool. */
 static size_t user_page_limit = SIZE_MAX;
 
+/* -largepages: Map kernel RAM with 4 MB pages where possible? */
+static bool large_pages;
+
+/* -bootprof: Print a table of boot phase durations? */
+static bool boot_profile;
+
+/* Boot phases, each recorded as the TSC value when it ended.
+   boot_phases[0] marks the kernel's entry into main().  Device
+   drivers may record phases of their own during boot, so a name
+   may appear more than once. */
+#define BOOT_PHASE_MAX 48
+struct boot_phase
+  {
+    const char *name;           /* Phase name. */
+    uint64_t tsc;               /* TSC when the phase ended. */
+  };
+static struct boot_phase boot_phases[BOOT_PHASE_MAX];
+static size_t boot_phase_cnt;
+static bool boot_done;          /* Stop recording phases? */
+
+static void print_boot_phases (void);
+
 static void bss_init (void);
 static void paging_init (void);
 
@@ -77,18 +104,26 @@ int
 main (void)
 {
   char **argv;
+  uint64_t start_tsc = clock_rdtsc ();
 
   /* Clear BSS. */  
   bss_init ();
+  boot_phases[0].name = "start";
+  boot_phases[0].tsc = start_tsc;
+  boot_phase_cnt = 1;
+  boot_phase ("bss_init");
 
   /* Break command line into arguments and parse options. */
   argv = read_command_line ();
   argv = parse_options (argv);
+  boot_phase ("parse_options");
 
   /* Initialize ourselves as a thread so we can use locks,
      then enable console locking. */
   thread_init ();
+  boot_phase ("thread_init");
   console_init ();  
+  boot_phase ("console_init");
 
   /* Greet user. */
   printf ("Pintos booting with %'"PRIu32" kB RAM...\n",
@@ -96,37 +131,70 @@ main (void)
 
   /* Initialize memory system. */
   palloc_init (user_page_limit);
+  boot_phase ("palloc_init");
   malloc_init ();
+  boot_phase ("malloc_init");
   paging_init ();
+  boot_phase ("paging_init");
+  cpu_init ();
+  boot_phase ("cpu_init");
 
   /* Segmentation. */
 #ifdef USERPROG
   tss_init ();
+  boot_phase ("tss_init");
   gdt_init ();
+  boot_phase ("gdt_init");
 #endif
 
   /* Initialize interrupt handlers. */
   intr_init ();
+  boot_phase ("intr_init");
   timer_init ();
+  boot_phase ("timer_init");
   kbd_init ();
+  boot_phase ("kbd_init");
   input_init ();
+  boot_phase ("input_init");
 #ifdef USERPROG
   exception_init ();
+  boot_phase ("exception_init");
   syscall_init ();
+  boot_phase ("syscall_init");
 #endif
 
   /* Start thread scheduler and enable interrupts. */
   thread_start ();
+  boot_phase ("thread_start");
   serial_init_queue ();
+  boot_phase ("serial_init_queue");
+#ifdef USERPROG
+  pagedir_init ();
+  boot_phase ("pagedir_init");
+#endif
+
+  /* Calibrate the clock first, so that the timer can calibrate
+     its delay loop against it in a fraction of a tick. */
+  clock_calibrate ();
+  boot_phase ("clock_calibrate");
   timer_calibrate ();
+  boot_phase ("timer_calibrate");
+
+  /* Start the other CPUs, which needs timer delays. */
+  cpu_start ();
+  boot_phase ("cpu_start");
 
 #ifdef FILESYS
   /* Initialize file system. */
   ide_init ();
+  boot_phase ("ide_init");
   locate_block_devices ();
+  boot_phase ("locate_block_devices");
   filesys_init (format_filesys);
+  boot_phase ("filesys_init");
 #endif
 
+  print_boot_phases ();
   printf ("Boot complete.\n");
   
   /* Run actions specified on kernel command line. */
@@ -137,6 +205,53 @@ main (void)
   thread_exit ();
 }
 
+/* Records that the boot phase named NAME has just ended.  Does
+   nothing once booting is complete. */
+void
+boot_phase (const char *name) 
+{
+  if (!boot_done && boot_phase_cnt < BOOT_PHASE_MAX) 
+    {
+      struct boot_phase *p = &boot_phases[boot_phase_cnt++];
+      p->name = name;
+      p->tsc = clock_rdtsc ();
+    }
+}
+
+/* Prints how long booting took and, with -bootprof, a table of
+   the duration of each phase.  The TSC rate is not known until
+   the clock has been calibrated, so the phases are recorded as
+   raw TSC values and converted only here. */
+static void
+print_boot_phases (void) 
+{
+  uint64_t total;
+  size_t i;
+
+  boot_done = true;
+  if (!clock_calibrated ())
+    return;
+
+  total = clock_cycles_to_ns (boot_phases[boot_phase_cnt - 1].tsc
+                              - boot_phases[0].tsc);
+  printf ("Boot took %'"PRIu64" us.\n", total / 1000);
+  if (!boot_profile || total == 0)
+    return;
+
+  printf ("%-24s %12s %7s\n", "Boot phase", "Time (us)", "Share");
+  for (i = 1; i < boot_phase_cnt; i++) 
+    {
+      uint64_t ns = clock_cycles_to_ns (boot_phases[i].tsc
+                                        - boot_phases[i - 1].tsc);
+      unsigned permille = ns * 1000 / total;
+      printf ("%-24s %'12"PRIu64" %4u.%u%%\n",
+              boot_phases[i].name, ns / 1000,
+              permille / 10, permille % 10);
+    }
+  if (boot_phase_cnt >= BOOT_PHASE_MAX)
+    printf ("(later phases not recorded)\n");
+}
+
 /* Clear the "BSS", a segment that should be initialized to
    zeros.  It isn't actually stored on disk or zeroed by the
    kernel loader, so we have to zero it ourselves.
@@ -153,14 +268,35 @@ bss_init (void)
 /* Populates the base page directory and page table with the
    kernel virtual mapping, and then sets up the CPU to use the
    new page directory.  Points init_page_dir to the page
-   directory it creates. */
+   directory it creates.
+
+   With -largepages, if the CPU supports it, each 4 MB region of
+   RAM is mapped by a single PDE instead of a page table, which
+   saves a page table page and many TLB entries per region.  The
+   region holding the kernel text, and a partial region at the
+   top of RAM, still use 4 kB pages, so that the text stays
+   read-only and no memory beyond RAM is mapped. */
 static void
 paging_init (void)
 {
   uint32_t *pd, *pt;
   size_t page;
+  bool use_large_pages;
   extern char _start, _end_kernel_text;
 
+  use_large_pages = large_pages && (cpuid_edx (1) & CPUID_PSE) != 0;
+  if (use_large_pages) 
+    {
+      /* Enable 4 MB pages.  This must happen before the new page
+         directory is loaded.  See [IA32-v3a] 3.7.3 "Mixing 4-KByte
+         and 4-MByte Pages". */
+      uint32_t cr4;
+      asm volatile ("movl %%cr4, %0" : "=r" (cr4));
+      asm volatile ("movl %0, %%cr4" : : "r" (cr4 | CR4_PSE));
+    }
+  else if (large_pages)
+    printf ("paging_init: CPU lacks 4 MB pages, using 4 kB pages\n");
+
   pd = init_page_dir = palloc_get_page (PAL_ASSERT | PAL_ZERO);
   pt = NULL;
   for (page = 0; page < init_ram_pages; page++)
@@ -171,6 +307,15 @@ paging_init (void)
       size_t pte_idx = pt_no (vaddr);
       bool in_kernel_text = &_start <= vaddr && vaddr < &_end_kernel_text;
 
+      if (use_large_pages && pte_idx == 0
+          && page + PTSPAN / PGSIZE <= init_ram_pages
+          && (vaddr + PTSPAN <= &_start || vaddr >= &_end_kernel_text))
+        {
+          pd[pde_idx] = pde_create_large (vaddr, true);
+          page += PTSPAN / PGSIZE - 1;
+          continue;
+        }
+
       if (pd[pde_idx] == 0)
         {
           pt = palloc_get_page (PAL_ASSERT | PAL_ZERO);
@@ -256,9 +401,43 @@ parse_options (char **argv)
         random_init (atoi (value));
       else if (!strcmp (name, "-mlfqs"))
         thread_mlfqs = true;
+      else if (!strcmp (name, "-tickless"))
+        timer_tickless = true;
+      else if (!strcmp (name, "-largepages"))
+        large_pages = true;
+      else if (!strcmp (name, "-bootprof"))
+        boot_profile = true;
+      else if (!strcmp (name, "-lpt"))
+        timer_set_loops_per_tick (atoi (value));
+      else if (!strcmp (name, "-tsc"))
+        clock_set_tsc_khz (atoi (value));
+      else if (!strcmp (name, "-schedstat"))
+        thread_schedstat = true;
+      else if (!strcmp (name, "-threadcache")) 
+        {
+          int cnt = value != NULL ? atoi (value) : -1;
+          if (cnt < 0)
+            PANIC ("option `-threadcache' requires a nonnegative count");
+          thread_cache_max = cnt;
+        }
+      else if (!strcmp (name, "-cpus")) 
+        {
+          int cnt = value != NULL ? atoi (value) : 0;
+          if (cnt < 1)
+            PANIC ("option `-cpus' requires a positive count");
+          cpu_limit = cnt;
+        }
+      else if (!strcmp (name, "-memstat"))
+        malloc_memstat = true;
+#ifdef LOCKSTAT
+      else if (!strcmp (name, "-lockstat"))
+        lockstat_top = value != NULL ? atoi (value) : 10;
+#endif
 #ifdef USERPROG
       else if (!strcmp (name, "-ul"))
         user_page_limit = atoi (value);
+      else if (!strcmp (name, "-procstat"))
+        process_procstat = true;
 #endif
       else
         PANIC ("unknown option `%s' (use -h for help)", name);
@@ -379,8 +558,21 @@ usage (void)
 #endif
           "  -rs=SEED           Set random number seed to SEED.\n"
           "  -mlfqs             Use multi-level feedback queue scheduler.\n"
+          "  -tickless          Stop the timer interrupt while idle.\n"
+          "  -largepages        Map kernel memory with 4 MB pages.\n"
+          "  -bootprof          Print how long each boot phase took.\n"
+          "  -lpt=N             Skip timer calibration, using N loops/tick.\n"
+          "  -tsc=KHZ           Skip clock calibration; the TSC runs at KHZ kHz.\n"
+          "  -schedstat         Print scheduler statistics at shutdown.\n"
+          "  -threadcache=N     Cache up to N exited threads' pages (default 8).\n"
+          "  -memstat           Print memory allocator statistics at shutdown.\n"
+          "  -cpus=N            Start at most N CPUs (default all, up to 8).\n"
+#ifdef LOCKSTAT
+          "  -lockstat[=N]      Print the N most contended locks at shutdown.\n"
+#endif
 #ifdef USERPROG
           "  -ul=COUNT          Limit user memory to COUNT pages.\n"
+          "  -procstat          Print process statistics at shutdown.\n"
 #endif
           );
   shutdown_power_off ();
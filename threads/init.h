@@ -9,4 +9,6 @@
 /* Page directory with kernel mappings only. */
 extern uint32_t *init_page_dir;
 
+void boot_phase (const char *name);
+
 #endif /* threads/init.h */
@@ -3,11 +3,14 @@
 #include <inttypes.h>
 #include <stdint.h>
 #include <stdio.h>
+#include "threads/cpu.h"
 #include "threads/flags.h"
 #include "threads/intr-stubs.h"
 #include "threads/io.h"
+#include "threads/synch.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
+#include "devices/lapic.h"
 #include "devices/timer.h"
 
 /* Programmable Interrupt Controller (PIC) registers.
@@ -38,14 +41,31 @@ static const char *intr_names[INTR_CNT];
 static unsigned int unexpected_cnt[INTR_CNT];
 
 /* External interrupts are those generated by devices outside the
-   CPU, such as the timer.  External interrupts run with
-   interrupts turned off, so they never nest, nor are they ever
-   pre-empted.  Handlers for external interrupts also may not
-   sleep, although they may invoke intr_yield_on_return() to
-   request that a new process be scheduled just before the
-   interrupt returns. */
-static bool in_external_intr;   /* Are we processing an external interrupt? */
-static bool yield_on_return;    /* Should we yield on interrupt return? */
+   CPU, such as the timer, and interprocessor interrupts (IPIs)
+   sent by other CPUs.  External interrupts run with interrupts
+   turned off, so they never nest, nor are they ever pre-empted.
+   Handlers for external interrupts also may not sleep, although
+   they may invoke intr_yield_on_return() to request that a new
+   process be scheduled just before the interrupt returns.  Each
+   CPU keeps track of its own external interrupt in its struct
+   cpu. */
+
+/* Interrupt lock.
+
+   With only one CPU, turning off interrupts makes code atomic,
+   and much of the kernel relies on that.  With more than one
+   CPU running (see cpu_smp), intr_disable() also acquires this
+   lock, and intr_enable() releases it, so that code that runs
+   with interrupts off still excludes all the other CPUs' code
+   that does the same.  A CPU holds the interrupt lock whenever
+   its interrupts are off, except within spin locks, which do
+   not need it, and interrupt handlers acquire it on entry.
+   schedule() lets go of it while a thread is switched out. */
+static struct spinlock intr_lock;
+
+/* True once cpu_start() has switched to the local APIC for
+   acknowledging external interrupts. */
+static bool use_apic;
 
 /* Programmable Interrupt Controller helpers. */
 static void pic_init (void);
@@ -83,13 +103,16 @@ intr_set_level (enum intr_level level)
   return level == INTR_ON ? intr_enable () : intr_disable ();
 }
 
-/* Enables interrupts and returns the previous interrupt status. */
+/* Enables interrupts and returns the previous interrupt status.
+   Also releases the interrupt lock, if this CPU holds it. */
 enum intr_level
 intr_enable (void) 
 {
   enum intr_level old_level = intr_get_level ();
   ASSERT (!intr_context ());
 
+  intr_lock_release ();
+
   /* Enable interrupts by setting the interrupt flag.
 
      See [IA32-v2b] "STI" and [IA32-v3a] 5.8.1 "Masking Maskable
@@ -99,7 +122,10 @@ intr_enable (void)
   return old_level;
 }
 
-/* Disables interrupts and returns the previous interrupt status. */
+/* Disables interrupts and returns the previous interrupt status.
+   With more than one CPU running, also acquires the interrupt
+   lock, if this CPU does not already hold it.  That must not be
+   done while holding a spin lock, such as sched_lock. */
 enum intr_level
 intr_disable (void) 
 {
@@ -110,8 +136,58 @@ intr_disable (void)
      Hardware Interrupts". */
   asm volatile ("cli" : : : "memory");
 
+  if (cpu_smp && !spinlock_held_by_current_cpu (&intr_lock))
+    spinlock_acquire (&intr_lock);
+
   return old_level;
 }
+
+/* Acquires the interrupt lock if no other CPU holds it, without
+   waiting.  Returns true if this CPU then holds the lock, or if
+   only one CPU is running, in which case there is no lock to
+   hold.  Interrupts must be off. */
+bool
+intr_lock_try_acquire (void) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  return (!cpu_smp
+          || spinlock_held_by_current_cpu (&intr_lock)
+          || spinlock_try_acquire (&intr_lock));
+}
+
+/* Releases the interrupt lock, leaving interrupts off, if this
+   CPU holds it.  Returns true if it did. */
+bool
+intr_lock_release (void) 
+{
+  if (!spinlock_held_by_current_cpu (&intr_lock))
+    return false;
+  spinlock_release (&intr_lock);
+  return true;
+}
+
+/* Releases the interrupt lock, if this CPU holds it, then turns
+   interrupts on and waits for the next one.  Interrupts must be
+   off.
+
+   The `sti' instruction disables interrupts until the completion
+   of the next instruction, so these two instructions are
+   executed atomically.  This atomicity is important; otherwise,
+   an interrupt could be handled between re-enabling interrupts
+   and waiting for the next one to occur, wasting as much as one
+   clock tick worth of time.
+
+   See [IA32-v2a] "HLT", [IA32-v2b] "STI", and [IA32-v3a] 7.11.1
+   "HLT Instruction". */
+void
+intr_halt (void) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  intr_lock_release ();
+  asm volatile ("sti; hlt" : : : "memory");
+}
 
 /* Initializes the interrupt system. */
 void
@@ -120,6 +196,8 @@ intr_init (void)
   uint64_t idtr_operand;
   int i;
 
+  spinlock_init (&intr_lock);
+
   /* Initialize interrupt controller. */
   pic_init ();
 
@@ -155,6 +233,30 @@ intr_init (void)
   intr_names[17] = "#AC Alignment Check Exception";
   intr_names[18] = "#MC Machine-Check Exception";
   intr_names[19] = "#XF SIMD Floating-Point Exception";
+  intr_names[LAPIC_SPURIOUS_VEC] = "Local APIC Spurious Interrupt";
+}
+
+/* Loads the IDT that intr_init() set up into an application
+   processor, which shares it with the other CPUs. */
+void
+intr_init_ap (void) 
+{
+  uint64_t idtr_operand = make_idtr_operand (sizeof idt - 1, idt);
+  asm volatile ("lidt %0" : : "m" (idtr_operand));
+}
+
+/* Stops using the 8259A PICs, by masking all their interrupts,
+   and acknowledges external interrupts on the local APIC
+   instead.  Called by cpu_start() as it routes the interrupts
+   through the I/O APIC.  Interrupts must be off. */
+void
+intr_use_apic (void) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  outb (PIC0_DATA, 0xff);
+  outb (PIC1_DATA, 0xff);
+  use_apic = true;
 }
 
 /* Registers interrupt VEC_NO to invoke HANDLER with descriptor
@@ -185,6 +287,17 @@ intr_register_ext (uint8_t vec_no, intr_handler_func *handler,
   register_handler (vec_no, 0, INTR_OFF, handler, name);
 }
 
+/* Registers interprocessor interrupt VEC_NO to invoke HANDLER,
+   which is named NAME for debugging purposes.  The handler runs
+   as an external interrupt handler. */
+void
+intr_register_ipi (uint8_t vec_no, intr_handler_func *handler,
+                   const char *name) 
+{
+  ASSERT (vec_no >= 0xf0 && vec_no < LAPIC_SPURIOUS_VEC);
+  register_handler (vec_no, 0, INTR_OFF, handler, name);
+}
+
 /* Registers internal interrupt VEC_NO to invoke HANDLER, which
    is named NAME for debugging purposes.  The interrupt handler
    will be invoked with interrupt status LEVEL.
@@ -202,7 +315,7 @@ void
 intr_register_int (uint8_t vec_no, int dpl, enum intr_level level,
                    intr_handler_func *handler, const char *name)
 {
-  ASSERT (vec_no < 0x20 || vec_no > 0x2f);
+  ASSERT (vec_no < 0x20 || (vec_no > 0x2f && vec_no < 0xf0));
   register_handler (vec_no, dpl, level, handler, name);
 }
 
@@ -211,7 +324,9 @@ intr_register_int (uint8_t vec_no, int dpl, enum intr_level level,
 bool
 intr_context (void) 
 {
-  return in_external_intr;
+  /* Checking the interrupt level first keeps a thread that
+     migrates to another CPU from looking at the wrong CPU. */
+  return intr_get_level () == INTR_OFF && cpu_current ()->in_external_intr;
 }
 
 /* During processing of an external interrupt, directs the
@@ -222,7 +337,7 @@ void
 intr_yield_on_return (void) 
 {
   ASSERT (intr_context ());
-  yield_on_return = true;
+  cpu_current ()->yield_on_return = true;
 }
 
 /* 8259A Programmable Interrupt Controller. */
@@ -345,31 +460,47 @@ void
 intr_handler (struct intr_frame *frame) 
 {
   bool external;
+  bool locked = false;
   intr_handler_func *handler;
 
+  /* A handler that runs with interrupts off needs the interrupt
+     lock, like any other code that does. */
+  if (cpu_smp && intr_get_level () == INTR_OFF
+      && !spinlock_held_by_current_cpu (&intr_lock)) 
+    {
+      spinlock_acquire (&intr_lock);
+      locked = true;
+    }
+
   /* External interrupts are special.
      We only handle one at a time (so interrupts must be off)
-     and they need to be acknowledged on the PIC (see below).
-     An external interrupt handler cannot sleep. */
-  external = frame->vec_no >= 0x20 && frame->vec_no < 0x30;
+     and they need to be acknowledged on the PIC or local APIC
+     (see below).  An external interrupt handler cannot sleep. */
+  external = ((frame->vec_no >= 0x20 && frame->vec_no < 0x30)
+              || (frame->vec_no >= 0xf0
+                  && frame->vec_no < LAPIC_SPURIOUS_VEC));
   if (external) 
     {
+      struct cpu *c = cpu_current ();
+
       ASSERT (intr_get_level () == INTR_OFF);
       ASSERT (!intr_context ());
 
-      in_external_intr = true;
-      yield_on_return = false;
+      c->in_external_intr = true;
+      c->yield_on_return = false;
     }
 
   /* Invoke the interrupt's handler. */
   handler = intr_handlers[frame->vec_no];
   if (handler != NULL)
     handler (frame);
-  else if (frame->vec_no == 0x27 || frame->vec_no == 0x2f)
+  else if (frame->vec_no == 0x27 || frame->vec_no == 0x2f
+           || frame->vec_no == LAPIC_SPURIOUS_VEC)
     {
       /* There is no handler, but this interrupt can trigger
          spuriously due to a hardware fault or hardware race
-         condition.  Ignore it. */
+         condition.  Ignore it.  (A spurious local APIC interrupt
+         must not be acknowledged.) */
     }
   else
     unexpected_interrupt (frame);
@@ -377,15 +508,31 @@ intr_handler (struct intr_frame *frame)
   /* Complete the processing of an external interrupt. */
   if (external) 
     {
+      struct cpu *c = cpu_current ();
+
       ASSERT (intr_get_level () == INTR_OFF);
       ASSERT (intr_context ());
 
-      in_external_intr = false;
-      pic_end_of_interrupt (frame->vec_no); 
+      c->in_external_intr = false;
+      if (use_apic || frame->vec_no >= 0xf0)
+        lapic_eoi ();
+      else
+        pic_end_of_interrupt (frame->vec_no); 
 
-      if (yield_on_return) 
+      /* The thread may continue on another CPU after yielding. */
+      if (c->yield_on_return) 
         thread_yield (); 
     }
+
+  /* Give back the interrupt lock if we acquired it, or if the
+     interrupted code, which runs with interrupts on, does not
+     expect to hold it. */
+  if (cpu_smp) 
+    {
+      asm volatile ("cli" : : : "memory");
+      if (locked || (frame->eflags & FLAG_IF) != 0)
+        intr_lock_release ();
+    }
 }
 
 /* Handles an unexpected interrupt with interrupt frame F.  An
@@ -5,6 +5,7 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/interrupt.h"
 #include "threads/palloc.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
@@ -28,11 +29,64 @@
    blocks, we remove all of the arena's blocks from the free list
    and give the arena back to the page allocator.
 
-   We can't handle blocks bigger than 2 kB using this scheme,
-   because they're too big to fit in a single page with a
-   descriptor.  We handle those by allocating contiguous pages
-   with the page allocator and sticking the allocation size at
-   the beginning of the allocated block's arena header. */
+   Above 1 kB, powers of 2 would leave most of a page unused, so
+   there are two more descriptors, for the largest blocks of
+   which 3 and 2 fit in a page along with the arena header.
+
+   We can't handle bigger blocks using this scheme, because
+   they're too big to fit in a single page with a descriptor.
+   We handle those by allocating contiguous pages with the page
+   allocator and sticking the allocation size at the beginning of
+   the allocated block's arena header.  The page allocator hands
+   out exactly the number of pages requested, so such a block
+   wastes less than a page.  realloc() grows and shrinks these
+   blocks in place when it can.
+
+   Rounding up to a power of 2 wastes up to half of each block.
+   For kinds of object that are allocated often, an object cache
+   (see kmem_cache_create()) avoids the waste by using a
+   descriptor of its own, whose block size is the object size
+   rounded up only to a multiple of the word size.  Its arenas
+   work just like malloc()'s, so free() also works on objects
+   from a cache.
+
+   Taking a descriptor's lock on every malloc() and free() would
+   make it the hottest lock in the kernel.  Instead, each
+   descriptor has a "magazine", a small stack of free blocks.
+   malloc() and free() usually just pop or push a block on the
+   magazine, with interrupts briefly turned off instead of a
+   lock.  Only when the magazine is empty or full do they take the
+   lock, to move MAG_BATCH blocks between the magazine and the
+   descriptor's free list.  Blocks sitting in magazines keep their
+   arenas' pages in use, so when the page allocator runs dry, it
+   calls drain_magazines(), which empties every magazine back
+   into its free list and so frees any arena left unused.
+
+   If the kernel is built with MALLOC_DEBUG defined ("make
+   MALLOC_DEBUG=1"), every block handed out by malloc(), calloc(),
+   realloc(), or kmem_cache_alloc() is preceded by a struct
+   alloc_tag that records its size and the address of the code
+   that allocated it, and all the tags are kept on a list.  At
+   shutdown, malloc_print_stats() then reports the allocations
+   that were never freed, grouped by call site. */
+
+/* Number of blocks a magazine holds. */
+#define MAG_SIZE 16
+
+/* Number of blocks moved between a magazine and its
+   descriptor's free list at a time. */
+#define MAG_BATCH (MAG_SIZE / 2)
+
+/* A magazine: a small stack of free blocks for one descriptor,
+   protected by turning off interrupts.  Blocks in a magazine
+   count as in use as far as their arenas are concerned. */
+struct magazine
+  {
+    size_t cnt;                 /* Number of blocks in ROUNDS. */
+    void *rounds[MAG_SIZE];     /* Free blocks. */
+    long long alloc_cnt;        /* # of blocks allocated. */
+    long long free_cnt;         /* # of blocks freed. */
+  };
 
 /* Descriptor. */
 struct desc
@@ -41,6 +95,19 @@ struct desc
     size_t blocks_per_arena;    /* Number of blocks in an arena. */
     struct list free_list;      /* List of free blocks. */
     struct lock lock;           /* Lock. */
+    size_t arena_cnt;           /* # of arenas now in use. */
+    size_t max_arena_cnt;       /* Maximum arena_cnt. */
+    struct magazine mag;        /* Free blocks taken without the lock. */
+  };
+
+/* An object cache. */
+struct kmem_cache 
+  {
+    struct list_elem elem;      /* Element in cache_list. */
+    const char *name;           /* Name, for statistics. */
+    size_t obj_size;            /* Object size requested. */
+    kmem_ctor_func *ctor;       /* Constructor, or null. */
+    struct desc desc;           /* Descriptor for the objects. */
   };
 
 /* Magic number for detecting arena corruption. */
@@ -60,10 +127,61 @@ struct block
     struct list_elem free_elem; /* Free list element. */
   };
 
+#ifdef MALLOC_DEBUG
+/* Header of an allocated block, in MALLOC_DEBUG builds. */
+struct alloc_tag
+  {
+    struct list_elem elem;      /* Element in tag_list. */
+    void *caller;               /* Return address of allocator's caller. */
+    size_t size;                /* Size requested. */
+  };
+#define TAG_SIZE sizeof (struct alloc_tag)
+
+/* All allocated blocks, protected by turning off interrupts. */
+static struct list tag_list;
+
+static void print_leaks (void);
+#else
+#define TAG_SIZE 0
+#endif
+
+static void *tag_block (void *, size_t size, void *caller);
+static void *untag_block (void *);
+
+/* -memstat: Print allocator statistics at shutdown? */
+bool malloc_memstat;
+
+/* Big blocks, protected by turning off interrupts. */
+static size_t big_cnt;          /* # of big blocks in use. */
+static size_t big_page_cnt;     /* # of pages in big blocks. */
+static size_t max_big_page_cnt; /* Maximum big_page_cnt. */
+
+static void count_big (size_t old_page_cnt, size_t new_page_cnt);
+
 /* Our set of descriptors. */
-static struct desc descs[10];   /* Descriptors. */
+static struct desc descs[10];   /* Descriptors, by increasing size. */
 static size_t desc_cnt;         /* Number of descriptors. */
 
+/* All the object caches. */
+static struct list cache_list;
+static struct lock cache_list_lock;
+
+static void desc_init (struct desc *, size_t block_size,
+                       const char *name, int index);
+static struct desc *find_desc (size_t size);
+static void *desc_alloc (struct desc *);
+static void desc_free (struct desc *, struct block *);
+static size_t take_blocks (struct desc *, struct block **, size_t cnt);
+static void put_blocks (struct desc *, struct block **, size_t cnt);
+static void put_blocks_locked (struct desc *, struct block **, size_t cnt);
+static palloc_reclaim_func drain_magazines;
+static bool drain_desc (struct desc *);
+static void desc_counts (struct desc *, long long *alloc_cnt,
+                         long long *free_cnt);
+static void print_desc (struct desc *, const char *name);
+static void *raw_malloc (size_t);
+static void *raw_realloc (void *, size_t);
+static void raw_free (void *);
 static struct arena *block_to_arena (struct block *);
 static struct block *arena_to_block (struct arena *, size_t idx);
 
@@ -72,25 +190,62 @@ void
 malloc_init (void) 
 {
   size_t block_size;
+  int per_arena;
 
   for (block_size = 16; block_size < PGSIZE / 2; block_size *= 2)
     {
       struct desc *d = &descs[desc_cnt++];
       ASSERT (desc_cnt <= sizeof descs / sizeof *descs);
-      d->block_size = block_size;
-      d->blocks_per_arena = (PGSIZE - sizeof (struct arena)) / block_size;
-      list_init (&d->free_list);
-      lock_init (&d->lock);
+      desc_init (d, block_size, "malloc", block_size);
     }
+  for (per_arena = 3; per_arena >= 2; per_arena--) 
+    {
+      struct desc *d = &descs[desc_cnt++];
+      ASSERT (desc_cnt <= sizeof descs / sizeof *descs);
+      block_size = (PGSIZE - sizeof (struct arena)) / per_arena;
+      block_size = ROUND_DOWN (block_size, sizeof (void *));
+      desc_init (d, block_size, "malloc", block_size);
+    }
+
+  list_init (&cache_list);
+  lock_init (&cache_list_lock);
+  palloc_add_reclaimer (drain_magazines, true);
+#ifdef MALLOC_DEBUG
+  list_init (&tag_list);
+#endif
+}
+
+/* Initializes descriptor D for blocks of BLOCK_SIZE bytes.
+   NAME and INDEX identify D's lock in lock statistics. */
+static void
+desc_init (struct desc *d, size_t block_size, const char *name, int index) 
+{
+  d->block_size = block_size;
+  d->blocks_per_arena = (PGSIZE - sizeof (struct arena)) / block_size;
+  list_init (&d->free_list);
+  lock_init_named (&d->lock, name, index);
+  d->arena_cnt = d->max_arena_cnt = 0;
+  memset (&d->mag, 0, sizeof d->mag);
 }
 
 /* Obtains and returns a new block of at least SIZE bytes.
    Returns a null pointer if memory is not available. */
 void *
 malloc (size_t size) 
+{
+  if (size == 0)
+    return NULL;
+  return tag_block (raw_malloc (size + TAG_SIZE), size,
+                    __builtin_return_address (0));
+}
+
+/* Obtains and returns a new block of at least SIZE bytes,
+   without an allocation tag.  Returns a null pointer if memory
+   is not available. */
+static void *
+raw_malloc (size_t size) 
 {
   struct desc *d;
-  struct block *b;
   struct arena *a;
 
   /* A null pointer satisfies a request for 0 bytes. */
@@ -99,10 +254,8 @@ malloc (size_t size)
 
   /* Find the smallest descriptor that satisfies a SIZE-byte
      request. */
-  for (d = descs; d < descs + desc_cnt; d++)
-    if (d->block_size >= size)
-      break;
-  if (d == descs + desc_cnt) 
+  d = find_desc (size);
+  if (d == NULL) 
     {
       /* SIZE is too big for any descriptor.
          Allocate enough pages to hold SIZE plus an arena. */
@@ -116,41 +269,127 @@ malloc (size_t size)
       a->magic = ARENA_MAGIC;
       a->desc = NULL;
       a->free_cnt = page_cnt;
+      count_big (0, page_cnt);
       return a + 1;
     }
 
-  lock_acquire (&d->lock);
+  return desc_alloc (d);
+}
+
+/* Returns the smallest descriptor for blocks of at least SIZE
+   bytes, or a null pointer if SIZE is too big for any. */
+static struct desc *
+find_desc (size_t size) 
+{
+  struct desc *d;
+
+  for (d = descs; d < descs + desc_cnt; d++)
+    if (d->block_size >= size)
+      return d;
+  return NULL;
+}
+
+/* Obtains and returns a block from descriptor D.  Returns a
+   null pointer if memory is not available. */
+static void *
+desc_alloc (struct desc *d) 
+{
+  struct block *blocks[MAG_BATCH];
+  struct magazine *m;
+  enum intr_level old_level;
+  size_t cnt, i;
+
+  /* Fast path: take a block from the magazine. */
+  old_level = intr_disable ();
+  m = &d->mag;
+  if (m->cnt > 0) 
+    {
+      void *b = m->rounds[--m->cnt];
+      m->alloc_cnt++;
+      intr_set_level (old_level);
+      return b;
+    }
+  intr_set_level (old_level);
+
+  /* Slow path: refill the magazine from the free list. */
+  cnt = take_blocks (d, blocks, MAG_BATCH);
+  if (cnt == 0)
+    return NULL;
+
+  old_level = intr_disable ();
+  m = &d->mag;
+  m->alloc_cnt++;
+  for (i = 1; i < cnt && m->cnt < MAG_SIZE; i++)
+    m->rounds[m->cnt++] = blocks[i];
+  intr_set_level (old_level);
+
+  /* Another thread may have refilled the magazine meanwhile. */
+  if (i < cnt)
+    put_blocks (d, blocks + i, cnt - i);
+  return blocks[0];
+}
+
+/* Takes up to CNT blocks from D's free list and stores them in
+   BLOCKS, creating a new arena if the free list is empty.
+   Returns the number of blocks taken, which is 0 only if memory
+   is not available. */
+static size_t
+take_blocks (struct desc *d, struct block **blocks, size_t cnt) 
+{
+  size_t taken = 0;
 
-  /* If the free list is empty, create a new arena. */
-  if (list_empty (&d->free_list))
+  lock_acquire (&d->lock);
+  while (taken < cnt) 
     {
-      size_t i;
+      struct block *b;
+      struct arena *a;
 
-      /* Allocate a page. */
-      a = palloc_get_page (0);
-      if (a == NULL) 
+      /* If the free list is empty, create a new arena, unless
+         we already have some blocks. */
+      if (list_empty (&d->free_list))
         {
+          size_t i;
+
+          if (taken > 0)
+            break;
+
+          /* Allocate a page.  The lock is released meanwhile,
+             because the page allocator drains this descriptor's
+             magazine if the pool is empty, and then the free list
+             must be checked again. */
           lock_release (&d->lock);
-          return NULL; 
+          a = palloc_get_page (0);
+          lock_acquire (&d->lock);
+          if (!list_empty (&d->free_list)) 
+            {
+              if (a != NULL)
+                palloc_free_page (a);
+              continue;
+            }
+          if (a == NULL) 
+            break;
+          if (++d->arena_cnt > d->max_arena_cnt)
+            d->max_arena_cnt = d->arena_cnt;
+
+          /* Initialize arena and add its blocks to the free list. */
+          a->magic = ARENA_MAGIC;
+          a->desc = d;
+          a->free_cnt = d->blocks_per_arena;
+          for (i = 0; i < d->blocks_per_arena; i++) 
+            {
+              struct block *b = arena_to_block (a, i);
+              list_push_back (&d->free_list, &b->free_elem);
+            }
         }
 
-      /* Initialize arena and add its blocks to the free list. */
-      a->magic = ARENA_MAGIC;
-      a->desc = d;
-      a->free_cnt = d->blocks_per_arena;
-      for (i = 0; i < d->blocks_per_arena; i++) 
-        {
-          struct block *b = arena_to_block (a, i);
-          list_push_back (&d->free_list, &b->free_elem);
-        }
+      /* Get a block from free list. */
+      b = list_entry (list_pop_front (&d->free_list), struct block, free_elem);
+      a = block_to_arena (b);
+      a->free_cnt--;
+      blocks[taken++] = b;
     }
-
-  /* Get a block from free list and return it. */
-  b = list_entry (list_pop_front (&d->free_list), struct block, free_elem);
-  a = block_to_arena (b);
-  a->free_cnt--;
   lock_release (&d->lock);
-  return b;
+  return taken;
 }
 
 /* Allocates and return A times B bytes initialized to zeroes.
@@ -167,7 +406,10 @@ calloc (size_t a, size_t b)
     return NULL;
 
   /* Allocate and zero memory. */
-  p = malloc (size);
+  if (size == 0)
+    return NULL;
+  p = tag_block (raw_malloc (size + TAG_SIZE), size,
+                 __builtin_return_address (0));
   if (p != NULL)
     memset (p, 0, size);
 
@@ -185,6 +427,36 @@ block_size (void *block)
   return d != NULL ? d->block_size : PGSIZE * a->free_cnt - pg_ofs (block);
 }
 
+/* Attempts to resize OLD_BLOCK to NEW_SIZE bytes in place.
+   Returns true if successful, false if it must be moved. */
+static bool
+resize_in_place (void *old_block, size_t new_size) 
+{
+  struct arena *a = block_to_arena (old_block);
+  size_t page_cnt;
+
+  /* A block from a descriptor can stay put if malloc() would
+     use the same descriptor for NEW_SIZE. */
+  if (a->desc != NULL)
+    return find_desc (new_size) == a->desc;
+
+  /* A big block that is to stay big can shrink by giving back
+     the pages at its end, or grow by taking the pages after it
+     if they are free. */
+  if (find_desc (new_size) != NULL)
+    return false;
+  page_cnt = DIV_ROUND_UP (new_size + sizeof *a, PGSIZE);
+  if (page_cnt < a->free_cnt)
+    palloc_free_multiple ((uint8_t *) a + PGSIZE * page_cnt,
+                          a->free_cnt - page_cnt);
+  else if (page_cnt > a->free_cnt
+           && !palloc_extend_multiple (a, a->free_cnt, page_cnt))
+    return false;
+  count_big (a->free_cnt, page_cnt);
+  a->free_cnt = page_cnt;
+  return true;
+}
+
 /* Attempts to resize OLD_BLOCK to NEW_SIZE bytes, possibly
    moving it in the process.
    If successful, returns the new block; on failure, returns a
@@ -194,20 +466,44 @@ block_size (void *block)
 void *
 realloc (void *old_block, size_t new_size) 
 {
+  void *raw_block;
+
   if (new_size == 0) 
     {
       free (old_block);
       return NULL;
     }
+
+  raw_block = raw_realloc (untag_block (old_block), new_size + TAG_SIZE);
+  if (raw_block != NULL)
+    return tag_block (raw_block, new_size, __builtin_return_address (0));
+#ifdef MALLOC_DEBUG
+  if (old_block != NULL) 
+    {
+      /* OLD_BLOCK is unchanged, so put its tag back. */
+      struct alloc_tag *t = (struct alloc_tag *) old_block - 1;
+      tag_block (t, t->size, t->caller);
+    }
+#endif
+  return NULL;
+}
+
+/* Like realloc(), but for blocks without allocation tags, and
+   NEW_SIZE must be nonzero. */
+static void *
+raw_realloc (void *old_block, size_t new_size) 
+{
+  if (old_block != NULL && resize_in_place (old_block, new_size))
+    return old_block;
   else 
     {
-      void *new_block = malloc (new_size);
+      void *new_block = raw_malloc (new_size);
       if (old_block != NULL && new_block != NULL)
         {
           size_t old_size = block_size (old_block);
           size_t min_size = new_size < old_size ? new_size : old_size;
           memcpy (new_block, old_block, min_size);
-          free (old_block);
+          raw_free (old_block);
         }
       return new_block;
     }
@@ -217,6 +513,13 @@ realloc (void *old_block, size_t new_size)
    malloc(), calloc(), or realloc(). */
 void
 free (void *p) 
+{
+  raw_free (untag_block (p));
+}
+
+/* Frees block P, which has no allocation tag. */
+static void
+raw_free (void *p) 
 {
   if (p != NULL)
     {
@@ -227,42 +530,410 @@ free (void *p)
       if (d != NULL) 
         {
           /* It's a normal block.  We handle it here. */
+          desc_free (d, b);
+        }
+      else
+        {
+          /* It's a big block.  Free its pages. */
+          count_big (a->free_cnt, 0);
+          palloc_free_multiple (a, a->free_cnt);
+          return;
+        }
+    }
+}
+
+/* Returns block B to descriptor D. */
+static void
+desc_free (struct desc *d, struct block *b) 
+{
+  struct block *blocks[MAG_BATCH + 1];
+  struct magazine *m;
+  enum intr_level old_level;
+  size_t cnt;
+
+  ASSERT (block_to_arena (b)->desc == d);
 
 #ifndef NDEBUG
-          /* Clear the block to help detect use-after-free bugs. */
-          memset (b, 0xcc, d->block_size);
+  /* Clear the block to help detect use-after-free bugs. */
+  memset (b, 0xcc, d->block_size);
 #endif
-  
-          lock_acquire (&d->lock);
 
-          /* Add block to free list. */
-          list_push_front (&d->free_list, &b->free_elem);
+  /* Fast path: put the block in the magazine. */
+  old_level = intr_disable ();
+  m = &d->mag;
+  m->free_cnt++;
+  if (m->cnt < MAG_SIZE) 
+    {
+      m->rounds[m->cnt++] = b;
+      intr_set_level (old_level);
+      return;
+    }
+
+  /* Slow path: the magazine is full, so return B and a batch of
+     blocks from the magazine to the free list. */
+  blocks[0] = b;
+  for (cnt = 1; cnt <= MAG_BATCH; cnt++)
+    blocks[cnt] = m->rounds[--m->cnt];
+  intr_set_level (old_level);
+  put_blocks (d, blocks, cnt);
+}
+
+/* Returns the CNT blocks in BLOCKS to D's free list, freeing
+   each arena that no longer has any blocks in use. */
+static void
+put_blocks (struct desc *d, struct block **blocks, size_t cnt) 
+{
+  lock_acquire (&d->lock);
+  put_blocks_locked (d, blocks, cnt);
+  lock_release (&d->lock);
+}
+
+/* Like put_blocks(), but D's lock must already be held. */
+static void
+put_blocks_locked (struct desc *d, struct block **blocks, size_t cnt) 
+{
+  size_t i;
+
+  ASSERT (lock_held_by_current_thread (&d->lock));
+
+  for (i = 0; i < cnt; i++) 
+    {
+      struct block *b = blocks[i];
+      struct arena *a = block_to_arena (b);
+
+      /* Add block to free list. */
+      list_push_front (&d->free_list, &b->free_elem);
 
-          /* If the arena is now entirely unused, free it. */
-          if (++a->free_cnt >= d->blocks_per_arena) 
+      /* If the arena is now entirely unused, free it. */
+      if (++a->free_cnt >= d->blocks_per_arena) 
+        {
+          size_t j;
+
+          ASSERT (a->free_cnt == d->blocks_per_arena);
+          for (j = 0; j < d->blocks_per_arena; j++) 
             {
-              size_t i;
-
-              ASSERT (a->free_cnt == d->blocks_per_arena);
-              for (i = 0; i < d->blocks_per_arena; i++) 
-                {
-                  struct block *b = arena_to_block (a, i);
-                  list_remove (&b->free_elem);
-                }
-              palloc_free_page (a);
+              struct block *b = arena_to_block (a, j);
+              list_remove (&b->free_elem);
             }
-
-          lock_release (&d->lock);
+          palloc_free_page (a);
+          d->arena_cnt--;
         }
-      else
+    }
+}
+
+/* Returns the blocks in all magazines, of malloc()'s descriptors
+   and of every object cache, to their free lists, freeing arenas
+   that are left with no blocks in use.  Returns true if any
+   magazine held a block.  Called by the page allocator when it
+   runs out of memory, to free the pages that magazines hold
+   onto. */
+static bool
+drain_magazines (void) 
+{
+  struct list_elem *e;
+  bool drained = false;
+  struct desc *d;
+
+  for (d = descs; d < descs + desc_cnt; d++)
+    if (drain_desc (d))
+      drained = true;
+
+  lock_acquire (&cache_list_lock);
+  for (e = list_begin (&cache_list); e != list_end (&cache_list);
+       e = list_next (e)) 
+    {
+      struct kmem_cache *c = list_entry (e, struct kmem_cache, elem);
+      if (drain_desc (&c->desc))
+        drained = true;
+    }
+  lock_release (&cache_list_lock);
+
+  return drained;
+}
+
+/* Empties D's magazine into D's free list.  Returns true if the
+   magazine held any blocks.
+
+   The page allocator may call this while the current thread
+   holds the lock of some descriptor, and another thread may be
+   doing the same with a different descriptor, so a descriptor
+   whose lock is held is skipped rather than waited for. */
+static bool
+drain_desc (struct desc *d) 
+{
+  struct block *blocks[MAG_SIZE];
+  enum intr_level old_level;
+  size_t cnt;
+
+  if (lock_held_by_current_thread (&d->lock)
+      || !lock_try_acquire (&d->lock))
+    return false;
+
+  old_level = intr_disable ();
+  cnt = d->mag.cnt;
+  memcpy (blocks, d->mag.rounds, cnt * sizeof *blocks);
+  d->mag.cnt = 0;
+  intr_set_level (old_level);
+
+  put_blocks_locked (d, blocks, cnt);
+  lock_release (&d->lock);
+  return cnt > 0;
+}
+
+/* Stores the total number of blocks allocated from and freed to
+   D in *ALLOC_CNT and *FREE_CNT. */
+static void
+desc_counts (struct desc *d, long long *alloc_cnt, long long *free_cnt) 
+{
+  enum intr_level old_level = intr_disable ();
+  *alloc_cnt = d->mag.alloc_cnt;
+  *free_cnt = d->mag.free_cnt;
+  intr_set_level (old_level);
+}
+
+/* Creates and returns a cache of objects of SIZE bytes, named
+   NAME for statistics.  NAME must remain valid as long as the
+   cache does.  If CTOR is nonnull, kmem_cache_alloc() calls it
+   to initialize each object before returning it.  Returns a
+   null pointer if memory is not available.
+
+   SIZE must be small enough for at least one object to fit in a
+   page along with an arena header.  Caches are never
+   destroyed. */
+struct kmem_cache *
+kmem_cache_create (const char *name, size_t size, kmem_ctor_func *ctor) 
+{
+  struct kmem_cache *c;
+  size_t block_size;
+
+  ASSERT (name != NULL);
+  ASSERT (size > 0);
+
+  block_size = ROUND_UP (size + TAG_SIZE, sizeof (void *));
+  if (block_size < sizeof (struct block))
+    block_size = sizeof (struct block);
+  ASSERT (block_size <= PGSIZE - sizeof (struct arena));
+
+  c = malloc (sizeof *c);
+  if (c == NULL)
+    return NULL;
+  c->name = name;
+  c->obj_size = size;
+  c->ctor = ctor;
+  desc_init (&c->desc, block_size, name, -1);
+
+  lock_acquire (&cache_list_lock);
+  list_push_back (&cache_list, &c->elem);
+  lock_release (&cache_list_lock);
+  return c;
+}
+
+/* Obtains and returns an object from cache C, initialized by
+   C's constructor if it has one.  Returns a null pointer if
+   memory is not available. */
+void *
+kmem_cache_alloc (struct kmem_cache *c) 
+{
+  void *obj = tag_block (desc_alloc (&c->desc), c->obj_size,
+                         __builtin_return_address (0));
+  if (obj != NULL && c->ctor != NULL)
+    c->ctor (obj);
+  return obj;
+}
+
+/* Returns OBJ, which must have been obtained from cache C, to
+   C.  Does nothing if OBJ is a null pointer. */
+void
+kmem_cache_free (struct kmem_cache *c, void *obj) 
+{
+  if (obj != NULL)
+    desc_free (&c->desc, untag_block (obj));
+}
+
+/* Prints the allocator statistics requested with -memstat, and
+   in MALLOC_DEBUG builds the allocations never freed. */
+void
+malloc_print_stats (void) 
+{
+  struct desc *d;
+  struct list_elem *e;
+
+#ifdef MALLOC_DEBUG
+  print_leaks ();
+#endif
+
+  if (!malloc_memstat)
+    return;
+
+  palloc_print_pools ();
+  for (d = descs; d < descs + desc_cnt; d++)
+    print_desc (d, NULL);
+
+  lock_acquire (&cache_list_lock);
+  for (e = list_begin (&cache_list); e != list_end (&cache_list);
+       e = list_next (e)) 
+    {
+      struct kmem_cache *c = list_entry (e, struct kmem_cache, elem);
+      print_desc (&c->desc, c->name);
+    }
+  lock_release (&cache_list_lock);
+
+  printf ("Malloc big blocks: %zu in use, %zu pages (max %zu)\n",
+          big_cnt, big_page_cnt, max_big_page_cnt);
+}
+
+/* Prints statistics for descriptor D, which belongs to the
+   object cache named NAME or, if NAME is null, to malloc(). */
+static void
+print_desc (struct desc *d, const char *name) 
+{
+  long long alloc_cnt, free_cnt, in_use;
+  size_t capacity = d->arena_cnt * d->blocks_per_arena;
+
+  desc_counts (d, &alloc_cnt, &free_cnt);
+  if (alloc_cnt == 0)
+    return;
+  in_use = alloc_cnt - free_cnt;
+  if (name != NULL)
+    printf ("Cache %s: ", name);
+  else
+    printf ("Malloc ");
+  printf ("%zu-byte blocks: %lld allocs, %lld in use of %zu (%lld%%), "
+          "%zu arenas (max %zu)\n",
+          d->block_size, alloc_cnt, in_use, capacity,
+          capacity > 0 ? in_use * 100 / (long long) capacity : 0,
+          d->arena_cnt, d->max_arena_cnt);
+}
+
+/* Adjusts the big block statistics for a big block that had
+   OLD_PAGE_CNT pages, or 0 if it is new, and now has
+   NEW_PAGE_CNT, or 0 if it is being freed. */
+static void
+count_big (size_t old_page_cnt, size_t new_page_cnt) 
+{
+  enum intr_level old_level = intr_disable ();
+
+  if (old_page_cnt == 0)
+    big_cnt++;
+  if (new_page_cnt == 0)
+    big_cnt--;
+  big_page_cnt += new_page_cnt - old_page_cnt;
+  if (big_page_cnt > max_big_page_cnt)
+    max_big_page_cnt = big_page_cnt;
+
+  intr_set_level (old_level);
+}
+
+/* In MALLOC_DEBUG builds, fills in the tag at the start of B,
+   which is a block of SIZE + TAG_SIZE bytes allocated by the
+   code that returns to CALLER, and returns the address just past
+   it.  Otherwise, returns B.  Returns a null pointer if B is
+   null. */
+static void *
+tag_block (void *b, size_t size UNUSED, void *caller UNUSED) 
+{
+#ifdef MALLOC_DEBUG
+  struct alloc_tag *t = b;
+  enum intr_level old_level;
+
+  if (t == NULL)
+    return NULL;
+  t->caller = caller;
+  t->size = size;
+  old_level = intr_disable ();
+  list_push_back (&tag_list, &t->elem);
+  intr_set_level (old_level);
+  return t + 1;
+#else
+  return b;
+#endif
+}
+
+/* Undoes tag_block(), returning the block that P was returned
+   for, or a null pointer if P is null. */
+static void *
+untag_block (void *p) 
+{
+#ifdef MALLOC_DEBUG
+  struct alloc_tag *t;
+  enum intr_level old_level;
+
+  if (p == NULL)
+    return NULL;
+  t = (struct alloc_tag *) p - 1;
+  old_level = intr_disable ();
+  list_remove (&t->elem);
+  intr_set_level (old_level);
+  return t;
+#else
+  return p;
+#endif
+}
+
+#ifdef MALLOC_DEBUG
+/* Maximum number of call sites print_leaks() reports. */
+#define LEAK_SITES 32
+
+/* Prints the outstanding allocations, grouped by call site, with
+   the sites holding the most bytes first.  Use the "backtrace"
+   utility to translate the addresses into function names. */
+static void
+print_leaks (void) 
+{
+  struct leak_site
+    {
+      void *caller;             /* Return address of allocator's caller. */
+      size_t cnt;               /* # of outstanding allocations. */
+      size_t bytes;             /* Total size of them. */
+    };
+  static struct leak_site sites[LEAK_SITES];
+  size_t site_cnt = 0, other_cnt = 0, total_cnt = 0, i;
+  enum intr_level old_level;
+  struct list_elem *e;
+
+  old_level = intr_disable ();
+  for (e = list_begin (&tag_list); e != list_end (&tag_list);
+       e = list_next (e)) 
+    {
+      struct alloc_tag *t = list_entry (e, struct alloc_tag, elem);
+
+      total_cnt++;
+      for (i = 0; i < site_cnt; i++)
+        if (sites[i].caller == t->caller)
+          break;
+      if (i == site_cnt) 
         {
-          /* It's a big block.  Free its pages. */
-          palloc_free_multiple (a, a->free_cnt);
-          return;
+          if (site_cnt == LEAK_SITES) 
+            {
+              other_cnt++;
+              continue;
+            }
+          sites[site_cnt].caller = t->caller;
+          sites[site_cnt].cnt = sites[site_cnt].bytes = 0;
+          site_cnt++;
         }
+      sites[i].cnt++;
+      sites[i].bytes += t->size;
+    }
+  intr_set_level (old_level);
+
+  printf ("Malloc: %zu allocations outstanding\n", total_cnt);
+  while (site_cnt > 0) 
+    {
+      size_t max = 0;
+
+      for (i = 1; i < site_cnt; i++)
+        if (sites[i].bytes > sites[max].bytes)
+          max = i;
+      printf ("  %p: %zu allocations, %zu bytes\n",
+              sites[max].caller, sites[max].cnt, sites[max].bytes);
+      sites[max] = sites[--site_cnt];
     }
+  if (other_cnt > 0)
+    printf ("  (%zu more allocations from other sites)\n", other_cnt);
 }
-
+#endif /* MALLOC_DEBUG */
+
 /* Returns the arena that block B is inside. */
 static struct arena *
 block_to_arena (struct block *b)
@@ -2,11 +2,13 @@
 #include <bitmap.h>
 #include <debug.h>
 #include <inttypes.h>
+#include <list.h>
 #include <round.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/interrupt.h"
 #include "threads/loader.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
@@ -23,13 +25,78 @@
 
    By default, half of system RAM is given to the kernel pool and
    half to the user pool.  That should be huge overkill for the
-   kernel pool, but that's just fine for demonstration purposes. */
+   kernel pool, but that's just fine for demonstration purposes.
+
+   Each pool is managed as a binary buddy system.  Free memory is
+   kept in blocks of 2**ORDER pages, for ORDER from 0 to
+   PAL_MAX_ORDER, each aligned (relative to the pool's base) on a
+   multiple of its size, with one free list per order.  A request
+   for N pages takes a block from the smallest nonempty list of
+   order at least ceil(log2(N)), splits it in halves as needed,
+   and gives back the pages past the N-th.  Freeing a block
+   merges it with its "buddy", the other half of the block of
+   the next larger order, for as long as the buddy is free too.
+   Both take time proportional to the number of orders, not the
+   size of the pool.
+
+   The free lists thread through the free pages themselves.
+   free_order[] records, for the first page of each free block,
+   1 + the block's order, and 0 for every other page, so that a
+   buddy can be checked in constant time.
+
+   The allocator is called with interrupts off (to free a dying
+   thread's page, for example), so the pools are protected by
+   turning off interrupts rather than by locks.
+
+   Zeroing a page for PAL_ZERO takes longer than allocating it,
+   so each pool also keeps a list of up to ZERO_POOL_MAX pages
+   that are already zeroed, which the idle thread refills by
+   calling palloc_zero_idle().  Zeroed pages are marked in use,
+   so the buddy system does not see them.
+
+   Other parts of the kernel also keep freed pages around for
+   reuse.  Each such cache registers a function with
+   palloc_add_reclaimer().  When an allocation fails, the
+   allocator returns the pool's zeroed pages to it and calls
+   every registered function, then tries once more before giving
+   up. */
+
+/* Largest block order.  Runs of more than 2**PAL_MAX_ORDER pages
+   are assembled from adjacent blocks of this order. */
+#define PAL_MAX_ORDER 10
+
+/* Maximum number of pre-zeroed pages per pool.  The idle thread
+   zeroes pages only while more than this many are free. */
+#define ZERO_POOL_MAX 16
+
+/* Maximum number of functions registered with
+   palloc_add_reclaimer(). */
+#define RECLAIMER_MAX 8
+
+/* A function that frees cached pages. */
+struct reclaimer
+  {
+    palloc_reclaim_func *func;          /* Function. */
+    bool may_sleep;                     /* May FUNC sleep? */
+  };
+
+static struct reclaimer reclaimers[RECLAIMER_MAX];
+static size_t reclaimer_cnt;
 
 /* A memory pool. */
 struct pool
   {
-    struct lock lock;                   /* Mutual exclusion. */
+    const char *name;                   /* Name, for statistics. */
     struct bitmap *used_map;            /* Bitmap of free pages. */
+    uint8_t *free_order;                /* 1 + order of free block heads. */
+    struct list free_lists[PAL_MAX_ORDER + 1]; /* Free blocks by order. */
+    size_t free_cnt;                    /* # of pages in free_lists. */
+    size_t max_used_cnt;                /* Most pages ever in use. */
+    struct list zero_list;              /* Pre-zeroed pages. */
+    size_t zero_cnt;                    /* # of pages in zero_list. */
+    long long zero_hits;                /* PAL_ZERO pages from zero_list. */
+    long long zero_misses;              /* PAL_ZERO pages zeroed on demand,
+                                           counting single pages only. */
     uint8_t *base;                      /* Base of pool. */
   };
 
@@ -39,6 +106,20 @@ static struct pool kernel_pool, user_pool;
 static void init_pool (struct pool *, void *base, size_t page_cnt,
                        const char *name);
 static bool page_from_pool (const struct pool *, void *page);
+static size_t pool_size (const struct pool *);
+static size_t take_pages (struct pool *, enum palloc_flags, size_t page_cnt);
+static bool reclaim (struct pool *);
+static size_t alloc_pages (struct pool *, size_t page_cnt);
+static size_t alloc_block (struct pool *, int order);
+static size_t alloc_large (struct pool *, size_t page_cnt);
+static void free_pages (struct pool *, size_t page_idx, size_t page_cnt);
+static void free_block (struct pool *, size_t page_idx, int order);
+static void claim_pages (struct pool *, size_t page_idx, size_t page_cnt);
+static void *get_zeroed_page (struct pool *);
+static bool release_zeroed_pages (struct pool *);
+static bool zero_one_page (struct pool *);
+static void note_usage (struct pool *);
+static void print_pool (struct pool *);
 
 /* Initializes the page allocator.  At most USER_PAGE_LIMIT
    pages are put into the user pool. */
@@ -61,6 +142,22 @@ palloc_init (size_t user_page_limit)
              user_pages, "user pool");
 }
 
+/* Registers FUNC to be called when a page allocation fails, to
+   free pages that a cache is holding onto.  FUNC must not
+   allocate pages itself.  If MAY_SLEEP is true, FUNC is called
+   only when the failing allocation was made with interrupts on,
+   outside an interrupt handler. */
+void
+palloc_add_reclaimer (palloc_reclaim_func *func, bool may_sleep) 
+{
+  ASSERT (func != NULL);
+  ASSERT (reclaimer_cnt < RECLAIMER_MAX);
+
+  reclaimers[reclaimer_cnt].func = func;
+  reclaimers[reclaimer_cnt].may_sleep = may_sleep;
+  reclaimer_cnt++;
+}
+
 /* Obtains and returns a group of PAGE_CNT contiguous free pages.
    If PAL_USER is set, the pages are obtained from the user pool,
    otherwise from the kernel pool.  If PAL_ZERO is set in FLAGS,
@@ -77,9 +174,16 @@ palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
   if (page_cnt == 0)
     return NULL;
 
-  lock_acquire (&pool->lock);
-  page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
-  lock_release (&pool->lock);
+  if ((flags & PAL_ZERO) && page_cnt == 1) 
+    {
+      pages = get_zeroed_page (pool);
+      if (pages != NULL)
+        return pages;
+    }
+
+  page_idx = take_pages (pool, flags, page_cnt);
+  if (page_idx == BITMAP_ERROR && reclaim (pool))
+    page_idx = take_pages (pool, flags, page_cnt);
 
   if (page_idx != BITMAP_ERROR)
     pages = pool->base + PGSIZE * page_idx;
@@ -118,6 +222,7 @@ void
 palloc_free_multiple (void *pages, size_t page_cnt) 
 {
   struct pool *pool;
+  enum intr_level old_level;
   size_t page_idx;
 
   ASSERT (pg_ofs (pages) == 0);
@@ -137,8 +242,72 @@ palloc_free_multiple (void *pages, size_t page_cnt)
   memset (pages, 0xcc, PGSIZE * page_cnt);
 #endif
 
+  old_level = intr_disable ();
   ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
   bitmap_set_multiple (pool->used_map, page_idx, page_cnt, false);
+  free_pages (pool, page_idx, page_cnt);
+  pool->free_cnt += page_cnt;
+  intr_set_level (old_level);
+}
+
+/* Tries to extend the run of PAGE_CNT pages at PAGES, obtained
+   from palloc_get_multiple(), to NEW_CNT pages by allocating the
+   pages that follow it.  Returns true if successful, false if
+   any of those pages is in use or outside the pool. */
+bool
+palloc_extend_multiple (void *pages, size_t page_cnt, size_t new_cnt) 
+{
+  struct pool *pool;
+  enum intr_level old_level;
+  size_t page_idx, extra_idx, extra_cnt;
+  bool ok;
+
+  ASSERT (pg_ofs (pages) == 0);
+  ASSERT (page_cnt > 0 && new_cnt >= page_cnt);
+
+  if (page_from_pool (&kernel_pool, pages))
+    pool = &kernel_pool;
+  else if (page_from_pool (&user_pool, pages))
+    pool = &user_pool;
+  else
+    NOT_REACHED ();
+
+  page_idx = pg_no (pages) - pg_no (pool->base);
+  extra_idx = page_idx + page_cnt;
+  extra_cnt = new_cnt - page_cnt;
+
+  old_level = intr_disable ();
+  ASSERT (bitmap_all (pool->used_map, page_idx, page_cnt));
+  ok = (extra_idx + extra_cnt <= pool_size (pool)
+        && bitmap_none (pool->used_map, extra_idx, extra_cnt));
+  if (ok) 
+    {
+      claim_pages (pool, extra_idx, extra_cnt);
+      bitmap_set_multiple (pool->used_map, extra_idx, extra_cnt, true);
+      pool->free_cnt -= extra_cnt;
+      note_usage (pool);
+    }
+  intr_set_level (old_level);
+
+  return ok;
+}
+
+/* Zeroes a free page and adds it to the pre-zeroed pages of
+   the kernel or user pool, if either has room for one.  Returns
+   true if it did, false if there was nothing to do.  Called by
+   the idle thread, with interrupts on. */
+bool
+palloc_zero_idle (void) 
+{
+  return zero_one_page (&kernel_pool) || zero_one_page (&user_pool);
+}
+
+/* Prints the utilization and fragmentation of each pool. */
+void
+palloc_print_pools (void) 
+{
+  print_pool (&kernel_pool);
+  print_pool (&user_pool);
 }
 
 /* Frees the page at PAGE. */
@@ -153,10 +322,13 @@ palloc_free_page (void *page)
 static void
 init_pool (struct pool *p, void *base, size_t page_cnt, const char *name) 
 {
-  /* We'll put the pool's used_map at its base.
-     Calculate the space needed for the bitmap
-     and subtract it from the pool's size. */
-  size_t bm_pages = DIV_ROUND_UP (bitmap_buf_size (page_cnt), PGSIZE);
+  /* We'll put the pool's used_map and free_order at its base.
+     Calculate the space needed for them and subtract it from the
+     pool's size. */
+  size_t bm_size = bitmap_buf_size (page_cnt);
+  size_t bm_pages = DIV_ROUND_UP (bm_size + page_cnt, PGSIZE);
+  int order;
+
   if (bm_pages > page_cnt)
     PANIC ("Not enough memory in %s for bitmap.", name);
   page_cnt -= bm_pages;
@@ -164,9 +336,21 @@ init_pool (struct pool *p, void *base, size_t page_cnt, const char *name)
   printf ("%zu pages available in %s.\n", page_cnt, name);
 
   /* Initialize the pool. */
-  lock_init (&p->lock);
-  p->used_map = bitmap_create_in_buf (page_cnt, base, bm_pages * PGSIZE);
+  p->name = name;
+  p->max_used_cnt = 0;
+  p->used_map = bitmap_create_in_buf (page_cnt, base, bm_size);
+  p->free_order = (uint8_t *) base + bm_size;
+  memset (p->free_order, 0, page_cnt);
+  for (order = 0; order <= PAL_MAX_ORDER; order++)
+    list_init (&p->free_lists[order]);
   p->base = base + bm_pages * PGSIZE;
+  list_init (&p->zero_list);
+  p->zero_cnt = 0;
+  p->zero_hits = p->zero_misses = 0;
+
+  /* Put all of its pages on the free lists. */
+  free_pages (p, 0, page_cnt);
+  p->free_cnt = page_cnt;
 }
 
 /* Returns true if PAGE was allocated from POOL,
@@ -176,7 +360,395 @@ page_from_pool (const struct pool *pool, void *page)
 {
   size_t page_no = pg_no (page);
   size_t start_page = pg_no (pool->base);
-  size_t end_page = start_page + bitmap_size (pool->used_map);
+  size_t end_page = start_page + pool_size (pool);
 
   return page_no >= start_page && page_no < end_page;
 }
+
+/* Returns the number of pages in POOL. */
+static size_t
+pool_size (const struct pool *pool) 
+{
+  return bitmap_size (pool->used_map);
+}
+
+/* Returns the address of page PAGE_IDX in POOL. */
+static struct list_elem *
+page_elem (struct pool *pool, size_t page_idx) 
+{
+  return (struct list_elem *) (pool->base + PGSIZE * page_idx);
+}
+
+/* Returns the index in POOL of the free block that begins with
+   list element E. */
+static size_t
+elem_page (struct pool *pool, struct list_elem *e) 
+{
+  return ((uint8_t *) e - pool->base) / PGSIZE;
+}
+
+/* Allocates PAGE_CNT contiguous pages from POOL for an
+   allocation with the given FLAGS and marks them in use.
+   Returns the index of the first, or BITMAP_ERROR if there is
+   no run that long. */
+static size_t
+take_pages (struct pool *pool, enum palloc_flags flags, size_t page_cnt) 
+{
+  enum intr_level old_level;
+  size_t page_idx;
+
+  old_level = intr_disable ();
+  page_idx = alloc_pages (pool, page_cnt);
+  if (page_idx != BITMAP_ERROR) 
+    {
+      bitmap_set_multiple (pool->used_map, page_idx, page_cnt, true);
+      pool->free_cnt -= page_cnt;
+      note_usage (pool);
+      if ((flags & PAL_ZERO) && page_cnt == 1)
+        pool->zero_misses++;
+    }
+  intr_set_level (old_level);
+
+  return page_idx;
+}
+
+/* Tries to free pages after an allocation from POOL has failed,
+   by returning POOL's zeroed pages to its free lists and calling
+   the registered reclaimers.  Reclaimers that may sleep are
+   skipped if the caller cannot.  Returns true if any pages were
+   freed. */
+static bool
+reclaim (struct pool *pool) 
+{
+  bool can_sleep = !intr_context () && intr_get_level () == INTR_ON;
+  enum intr_level old_level;
+  bool freed;
+  size_t i;
+
+  old_level = intr_disable ();
+  freed = release_zeroed_pages (pool);
+  intr_set_level (old_level);
+
+  for (i = 0; i < reclaimer_cnt; i++)
+    if ((can_sleep || !reclaimers[i].may_sleep) && reclaimers[i].func ())
+      freed = true;
+  return freed;
+}
+
+/* Allocates PAGE_CNT contiguous pages from POOL and returns the
+   index of the first, or BITMAP_ERROR if there is no run that
+   long.  Interrupts must be off. */
+static size_t
+alloc_pages (struct pool *pool, size_t page_cnt) 
+{
+  size_t page_idx;
+  int order = 0;
+
+  if (page_cnt > (1u << PAL_MAX_ORDER))
+    return alloc_large (pool, page_cnt);
+
+  while ((1u << order) < page_cnt)
+    order++;
+  page_idx = alloc_block (pool, order);
+  if (page_idx != BITMAP_ERROR)
+    free_pages (pool, page_idx + page_cnt, (1u << order) - page_cnt);
+  return page_idx;
+}
+
+/* Removes a block of 2**ORDER pages from POOL's free lists,
+   splitting a larger block if necessary, and returns the index
+   of its first page, or BITMAP_ERROR if there is none.
+   Interrupts must be off. */
+static size_t
+alloc_block (struct pool *pool, int order) 
+{
+  size_t page_idx;
+  int k;
+
+  for (k = order; k <= PAL_MAX_ORDER; k++)
+    if (!list_empty (&pool->free_lists[k]))
+      break;
+  if (k > PAL_MAX_ORDER)
+    return BITMAP_ERROR;
+
+  page_idx = elem_page (pool, list_pop_front (&pool->free_lists[k]));
+  pool->free_order[page_idx] = 0;
+
+  /* Give back the upper half until the block is the right
+     size. */
+  while (k > order) 
+    {
+      size_t buddy;
+
+      k--;
+      buddy = page_idx + (1u << k);
+      pool->free_order[buddy] = k + 1;
+      list_push_front (&pool->free_lists[k], page_elem (pool, buddy));
+    }
+  return page_idx;
+}
+
+/* Allocates PAGE_CNT contiguous pages, more than the largest
+   block holds, from POOL by finding enough free blocks of the
+   largest order in a row.  Returns the index of the first page,
+   or BITMAP_ERROR if there is no such run.  Interrupts must be
+   off.  This is slow, but such large runs are rare. */
+static size_t
+alloc_large (struct pool *pool, size_t page_cnt) 
+{
+  const size_t block_pages = 1u << PAL_MAX_ORDER;
+  size_t block_cnt = DIV_ROUND_UP (page_cnt, block_pages);
+  struct list *list = &pool->free_lists[PAL_MAX_ORDER];
+  struct list_elem *e;
+
+  for (e = list_begin (list); e != list_end (list); e = list_next (e)) 
+    {
+      size_t start = elem_page (pool, e);
+      size_t i;
+
+      for (i = 1; i < block_cnt; i++) 
+        {
+          size_t idx = start + i * block_pages;
+          if (idx >= pool_size (pool)
+              || pool->free_order[idx] != PAL_MAX_ORDER + 1)
+            break;
+        }
+      if (i < block_cnt)
+        continue;
+
+      for (i = 0; i < block_cnt; i++) 
+        {
+          size_t idx = start + i * block_pages;
+          list_remove (page_elem (pool, idx));
+          pool->free_order[idx] = 0;
+        }
+      free_pages (pool, start + page_cnt, block_cnt * block_pages - page_cnt);
+      return start;
+    }
+  return BITMAP_ERROR;
+}
+
+/* Returns the PAGE_CNT pages starting at PAGE_IDX to POOL's free
+   lists, as the largest aligned blocks that fit.  Interrupts
+   must be off, unless POOL is being initialized. */
+static void
+free_pages (struct pool *pool, size_t page_idx, size_t page_cnt) 
+{
+  size_t end = page_idx + page_cnt;
+
+  while (page_idx < end) 
+    {
+      int order = 0;
+
+      while (order < PAL_MAX_ORDER
+             && page_idx % (2u << order) == 0
+             && page_idx + (2u << order) <= end)
+        order++;
+      free_block (pool, page_idx, order);
+      page_idx += 1u << order;
+    }
+}
+
+/* Adds the block of 2**ORDER pages starting at PAGE_IDX to
+   POOL's free lists, first merging it with its buddy for as long
+   as the buddy is also free.  Interrupts must be off, unless
+   POOL is being initialized. */
+static void
+free_block (struct pool *pool, size_t page_idx, int order) 
+{
+  while (order < PAL_MAX_ORDER) 
+    {
+      size_t buddy = page_idx ^ (1u << order);
+
+      if (buddy + (1u << order) > pool_size (pool)
+          || pool->free_order[buddy] != order + 1)
+        break;
+      list_remove (page_elem (pool, buddy));
+      pool->free_order[buddy] = 0;
+      if (buddy < page_idx)
+        page_idx = buddy;
+      order++;
+    }
+
+  pool->free_order[page_idx] = order + 1;
+  list_push_front (&pool->free_lists[order], page_elem (pool, page_idx));
+}
+
+/* Removes the PAGE_CNT free pages starting at PAGE_IDX from
+   POOL's free lists.  Each free block that overlaps them is
+   removed, and its pages outside the range are freed again.
+   Interrupts must be off. */
+static void
+claim_pages (struct pool *pool, size_t page_idx, size_t page_cnt) 
+{
+  size_t end = page_idx + page_cnt;
+
+  while (page_idx < end) 
+    {
+      size_t head = page_idx, block_end;
+      int order;
+
+      /* Find the free block that contains PAGE_IDX. */
+      for (order = 0; order <= PAL_MAX_ORDER; order++) 
+        {
+          head = page_idx & ~((1u << order) - 1);
+          if (pool->free_order[head] == order + 1)
+            break;
+        }
+      ASSERT (order <= PAL_MAX_ORDER);
+      block_end = head + (1u << order);
+
+      /* Take it off its list and give back the parts outside
+         the range. */
+      list_remove (page_elem (pool, head));
+      pool->free_order[head] = 0;
+      free_pages (pool, head, page_idx - head);
+      if (block_end > end) 
+        {
+          free_pages (pool, end, block_end - end);
+          block_end = end;
+        }
+      page_idx = block_end;
+    }
+}
+
+/* Removes a page from POOL's pre-zeroed pages and returns it, or
+   returns a null pointer if there are none. */
+static void *
+get_zeroed_page (struct pool *pool) 
+{
+  enum intr_level old_level;
+  struct list_elem *e = NULL;
+
+  old_level = intr_disable ();
+  if (!list_empty (&pool->zero_list)) 
+    {
+      e = list_pop_front (&pool->zero_list);
+      pool->zero_cnt--;
+      pool->zero_hits++;
+      note_usage (pool);
+    }
+  intr_set_level (old_level);
+
+  /* The list element is the only part of the page that is not
+     zero. */
+  if (e != NULL)
+    memset (e, 0, sizeof *e);
+  return e;
+}
+
+/* Returns all of POOL's pre-zeroed pages to its free lists.
+   Returns true if there were any.  Interrupts must be off.
+
+   A page that zero_one_page() is still zeroing counts toward
+   zero_cnt but is not yet on the list, so zero_cnt is reduced
+   only for the pages actually released. */
+static bool
+release_zeroed_pages (struct pool *pool) 
+{
+  if (list_empty (&pool->zero_list))
+    return false;
+
+  while (!list_empty (&pool->zero_list)) 
+    {
+      struct list_elem *e = list_pop_front (&pool->zero_list);
+      size_t page_idx = elem_page (pool, e);
+
+      bitmap_reset (pool->used_map, page_idx);
+      free_pages (pool, page_idx, 1);
+      pool->free_cnt++;
+      pool->zero_cnt--;
+    }
+  return true;
+}
+
+/* Zeroes a free page and adds it to POOL's pre-zeroed pages, if
+   POOL has room for one and enough free pages.  Returns true if
+   successful, false otherwise. */
+static bool
+zero_one_page (struct pool *pool) 
+{
+  enum intr_level old_level;
+  size_t page_idx = BITMAP_ERROR;
+  struct list_elem *e;
+
+  old_level = intr_disable ();
+  if (pool->zero_cnt < ZERO_POOL_MAX && pool->free_cnt > ZERO_POOL_MAX) 
+    {
+      page_idx = alloc_pages (pool, 1);
+      if (page_idx != BITMAP_ERROR) 
+        {
+          bitmap_mark (pool->used_map, page_idx);
+          pool->free_cnt--;
+          pool->zero_cnt++;
+        }
+    }
+  intr_set_level (old_level);
+  if (page_idx == BITMAP_ERROR)
+    return false;
+
+  /* Zero the page with interrupts on.  It counts toward zero_cnt
+     already, so that no one else zeroes one too many. */
+  e = page_elem (pool, page_idx);
+  memset (e, 0, PGSIZE);
+
+  old_level = intr_disable ();
+  list_push_back (&pool->zero_list, e);
+  intr_set_level (old_level);
+  return true;
+}
+
+/* Updates POOL's high-water mark for pages in use.  Interrupts
+   must be off. */
+static void
+note_usage (struct pool *pool) 
+{
+  size_t used_cnt = pool_size (pool) - pool->free_cnt - pool->zero_cnt;
+  if (used_cnt > pool->max_used_cnt)
+    pool->max_used_cnt = used_cnt;
+}
+
+/* Prints POOL's utilization, how often its pre-zeroed pages
+   satisfied single-page PAL_ZERO requests, and the number of
+   free blocks of each order.  Fragmentation is the fraction of
+   free pages not in the largest free block, which is 0% when all
+   free pages could be allocated as a single run. */
+static void
+print_pool (struct pool *pool) 
+{
+  size_t block_cnt[PAL_MAX_ORDER + 1];
+  size_t size, free_cnt, zero_cnt, max_used_cnt, largest = 0;
+  long long zero_hits, zero_misses;
+  enum intr_level old_level;
+  int order;
+
+  old_level = intr_disable ();
+  size = pool_size (pool);
+  free_cnt = pool->free_cnt;
+  zero_cnt = pool->zero_cnt;
+  max_used_cnt = pool->max_used_cnt;
+  zero_hits = pool->zero_hits;
+  zero_misses = pool->zero_misses;
+  for (order = 0; order <= PAL_MAX_ORDER; order++) 
+    {
+      block_cnt[order] = list_size (&pool->free_lists[order]);
+      if (block_cnt[order] > 0)
+        largest = 1u << order;
+    }
+  intr_set_level (old_level);
+
+  printf ("Palloc %s: %zu pages, %zu in use (max %zu), %zu free, "
+          "%zu zeroed\n",
+          pool->name, size, size - free_cnt - zero_cnt, max_used_cnt,
+          free_cnt, zero_cnt);
+  printf ("Palloc %s: %lld zeroed page hits, %lld misses\n",
+          pool->name, zero_hits, zero_misses);
+  printf ("Palloc %s: largest free block %zu pages, %zu%% fragmented, "
+          "free blocks by order:",
+          pool->name, largest,
+          free_cnt > 0 ? (free_cnt - largest) * 100 / free_cnt : 0);
+  for (order = 0; order <= PAL_MAX_ORDER; order++)
+    printf (" %zu", block_cnt[order]);
+  printf ("\n");
+}
+
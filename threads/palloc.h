@@ -1,6 +1,7 @@
 #ifndef THREADS_PALLOC_H
 #define THREADS_PALLOC_H
 
+#include <stdbool.h>
 #include <stddef.h>
 
 /* How to allocate pages. */
@@ -11,10 +12,18 @@ enum palloc_flags
     PAL_USER = 004              /* User page. */
   };
 
+/* A function that frees pages held in a cache when the page
+   allocator runs out, and returns true if it freed any. */
+typedef bool palloc_reclaim_func (void);
+
 void palloc_init (size_t user_page_limit);
+void palloc_add_reclaimer (palloc_reclaim_func *, bool may_sleep);
 void *palloc_get_page (enum palloc_flags);
 void *palloc_get_multiple (enum palloc_flags, size_t page_cnt);
 void palloc_free_page (void *);
 void palloc_free_multiple (void *, size_t page_cnt);
+bool palloc_extend_multiple (void *, size_t page_cnt, size_t new_cnt);
+bool palloc_zero_idle (void);
+void palloc_print_pools (void);
 
 #endif /* threads/palloc.h */
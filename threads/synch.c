@@ -27,11 +27,66 @@
 */
 
 #include "threads/synch.h"
+#include <inttypes.h>
 #include <stdio.h>
 #include <string.h>
+#include "devices/clock.h"
+#include "devices/timer.h"
+#include "threads/cpu.h"
 #include "threads/interrupt.h"
 #include "threads/thread.h"
 
+#ifdef LOCKSTAT
+/* This file defines the functions that synch.h wraps. */
+#undef sema_init
+#undef sema_init_named
+#undef lock_init
+#undef lock_init_named
+#undef rwlock_init
+#undef rwlock_init_named
+
+/* Maximum number of distinct struct lockstats.  Objects
+   initialized after the table fills up keep no statistics. */
+#define LOCKSTAT_MAX 256
+
+/* All struct lockstats in use, and a list of them in no
+   particular order. */
+static struct lockstat lockstats[LOCKSTAT_MAX];
+static size_t lockstat_cnt;
+static struct list lockstat_list = LIST_INITIALIZER (lockstat_list);
+
+/* Number of initializations that found the table full. */
+static long long lockstat_dropped;
+
+/* Number of locks to print at shutdown. */
+int lockstat_top;
+
+static struct lockstat *lockstat_get (const char *name, int index,
+                                      const char *file, int line);
+static struct lockstat *lockstat_get_site (struct lockstat_site *);
+static void lockstat_acquired (struct lockstat *, bool contended,
+                               uint64_t wait_start);
+static list_less_func lockstat_less;
+#endif
+
+/* Maximum length of a chain of lock holders along which
+   lock_acquire() donates priority.  Longer chains are rare
+   enough that bounding the walk is worth the imprecision. */
+#define DONATION_DEPTH_MAX 8
+
+static list_less_func thread_priority_less;
+static void donate_priority (struct lock *);
+static void withdraw_donation (struct lock *);
+static timer_event_func sema_timeout_expire;
+
+/* A thread in sema_down_timeout(). */
+struct sema_timeout 
+  {
+    struct thread *thread;      /* The waiting thread. */
+    struct semaphore *sema;     /* Semaphore being waited for. */
+    bool timed_out;             /* Set when the timeout expires. */
+  };
+
 /* Initializes semaphore SEMA to VALUE.  A semaphore is a
    nonnegative integer along with two atomic operators for
    manipulating it:
@@ -48,6 +103,23 @@ sema_init (struct semaphore *sema, unsigned value)
 
   sema->value = value;
   list_init (&sema->waiters);
+#ifdef LOCKSTAT
+  sema->stat = NULL;
+#endif
+}
+
+/* Initializes SEMA to VALUE, like sema_init().  In a LOCKSTAT
+   kernel, SEMA's statistics are kept under NAME and INDEX, which
+   may be -1 if NAME alone identifies SEMA. */
+void
+sema_init_named (struct semaphore *sema, unsigned value,
+                 const char *name UNUSED, int index UNUSED) 
+{
+#ifdef LOCKSTAT
+  sema_init_stat (sema, value, name, index);
+#else
+  sema_init (sema, value);
+#endif
 }
 
 /* Down or "P" operation on a semaphore.  Waits for SEMA's value
@@ -60,19 +132,30 @@ sema_init (struct semaphore *sema, unsigned value)
 void
 sema_down (struct semaphore *sema) 
 {
-  enum intr_level old_level;
+#ifdef LOCKSTAT
+  bool contended;
+  uint64_t wait_start = 0;
+#endif
 
   ASSERT (sema != NULL);
   ASSERT (!intr_context ());
 
-  old_level = intr_disable ();
+  spinlock_acquire (&sched_lock);
+#ifdef LOCKSTAT
+  contended = sema->value == 0;
+  if (contended && sema->stat != NULL)
+    wait_start = clock_ns ();
+#endif
   while (sema->value == 0) 
     {
       list_push_back (&sema->waiters, &thread_current ()->elem);
       thread_block ();
     }
   sema->value--;
-  intr_set_level (old_level);
+#ifdef LOCKSTAT
+  lockstat_acquired (sema->stat, contended, wait_start);
+#endif
+  spinlock_release (&sched_lock);
 }
 
 /* Down or "P" operation on a semaphore, but only if the
@@ -83,41 +166,138 @@ sema_down (struct semaphore *sema)
 bool
 sema_try_down (struct semaphore *sema) 
 {
-  enum intr_level old_level;
   bool success;
 
   ASSERT (sema != NULL);
 
-  old_level = intr_disable ();
+  spinlock_acquire (&sched_lock);
   if (sema->value > 0) 
     {
       sema->value--;
       success = true; 
+#ifdef LOCKSTAT
+      lockstat_acquired (sema->stat, false, 0);
+#endif
     }
   else
     success = false;
+  spinlock_release (&sched_lock);
+
+  return success;
+}
+
+/* Down or "P" operation on a semaphore, giving up after TICKS
+   timer ticks.  Returns true if the semaphore was decremented,
+   false if the timeout expired first.  If TICKS is 0 or less,
+   this is the same as sema_try_down().
+
+   This function may sleep, so it must not be called within an
+   interrupt handler.  This function may be called with
+   interrupts disabled, but if it sleeps then the next scheduled
+   thread will probably turn interrupts back on. */
+bool
+sema_down_timeout (struct semaphore *sema, int64_t ticks) 
+{
+  struct sema_timeout st;
+  struct timer_event timeout;
+  enum intr_level old_level;
+  bool success;
+#ifdef LOCKSTAT
+  bool contended;
+  uint64_t wait_start = 0;
+#endif
+
+  ASSERT (sema != NULL);
+  ASSERT (!intr_context ());
+
+  if (ticks <= 0)
+    return sema_try_down (sema);
+
+  st.thread = thread_current ();
+  st.sema = sema;
+  st.timed_out = false;
+  timer_event_init (&timeout, sema_timeout_expire, &st);
+
+  /* The timer wheel is protected by the interrupt lock, which
+     must be taken before sched_lock. */
+  old_level = intr_disable ();
+  spinlock_acquire (&sched_lock);
+#ifdef LOCKSTAT
+  contended = sema->value == 0;
+  if (contended && sema->stat != NULL)
+    wait_start = clock_ns ();
+#endif
+  if (sema->value == 0)
+    timer_event_schedule (&timeout, ticks);
+  while (sema->value == 0 && !st.timed_out) 
+    {
+      list_push_back (&sema->waiters, &st.thread->elem);
+      thread_block ();
+    }
+  timer_event_cancel (&timeout);
+  success = sema->value > 0;
+  if (success) 
+    {
+      sema->value--;
+#ifdef LOCKSTAT
+      lockstat_acquired (sema->stat, contended, wait_start);
+#endif
+    }
+  spinlock_release (&sched_lock);
   intr_set_level (old_level);
 
   return success;
 }
 
+/* Timer event function for sema_down_timeout().  If the thread
+   in ST_, a struct sema_timeout, is still blocked on its
+   semaphore, takes it off the semaphore's waiting list and wakes
+   it up. */
+static void
+sema_timeout_expire (void *st_) 
+{
+  struct sema_timeout *st = st_;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  spinlock_acquire (&sched_lock);
+  st->timed_out = true;
+
+  /* The thread is blocked only while it is on the semaphore's
+     waiting list.  If sema_up() has already woken it, it will
+     see the timeout or the semaphore's value when it runs. */
+  if (st->thread->status == THREAD_BLOCKED) 
+    {
+      list_remove (&st->thread->elem);
+      thread_unblock (st->thread);
+    }
+  spinlock_release (&sched_lock);
+}
+
 /* Up or "V" operation on a semaphore.  Increments SEMA's value
-   and wakes up one thread of those waiting for SEMA, if any.
+   and wakes up the highest-priority thread of those waiting for
+   SEMA, if any, choosing the one that has waited longest in case
+   of a tie.  If the thread woken up has a higher priority than the running
+   thread, yields the CPU to it.
 
    This function may be called from an interrupt handler. */
 void
 sema_up (struct semaphore *sema) 
 {
-  enum intr_level old_level;
-
   ASSERT (sema != NULL);
 
-  old_level = intr_disable ();
+  spinlock_acquire (&sched_lock);
   if (!list_empty (&sema->waiters)) 
-    thread_unblock (list_entry (list_pop_front (&sema->waiters),
-                                struct thread, elem));
+    {
+      struct list_elem *e = list_max (&sema->waiters,
+                                      thread_priority_less, NULL);
+      list_remove (e);
+      thread_unblock (list_entry (e, struct thread, elem));
+    }
   sema->value++;
-  intr_set_level (old_level);
+  spinlock_release (&sched_lock);
+
+  thread_preempt ();
 }
 
 static void sema_test_helper (void *sema_);
@@ -179,12 +359,35 @@ lock_init (struct lock *lock)
 
   lock->holder = NULL;
   sema_init (&lock->semaphore, 1);
+#ifdef LOCKSTAT
+  lock->stat = NULL;
+#endif
+}
+
+/* Initializes LOCK, like lock_init().  In a LOCKSTAT kernel,
+   LOCK's statistics are kept under NAME and INDEX, which may be
+   -1 if NAME alone identifies LOCK. */
+void
+lock_init_named (struct lock *lock, const char *name UNUSED,
+                 int index UNUSED) 
+{
+#ifdef LOCKSTAT
+  lock_init_stat (lock, name, index);
+#else
+  lock_init (lock);
+#endif
 }
 
 /* Acquires LOCK, sleeping until it becomes available if
    necessary.  The lock must not already be held by the current
    thread.
 
+   If the lock is held by another thread, the current thread
+   donates its priority to the holder, and transitively to the
+   holder of any lock that the holder is itself waiting for, so
+   that a lower-priority holder cannot starve it.  (The MLFQS
+   does not use priority donation.)
+
    This function may sleep, so it must not be called within an
    interrupt handler.  This function may be called with
    interrupts disabled, but interrupts will be turned back on if
@@ -192,12 +395,37 @@ lock_init (struct lock *lock)
 void
 lock_acquire (struct lock *lock)
 {
+  struct thread *cur = thread_current ();
+#ifdef LOCKSTAT
+  bool contended;
+  uint64_t wait_start = 0;
+#endif
+
   ASSERT (lock != NULL);
   ASSERT (!intr_context ());
   ASSERT (!lock_held_by_current_thread (lock));
 
+  spinlock_acquire (&sched_lock);
+#ifdef LOCKSTAT
+  contended = lock->holder != NULL;
+  if (contended && lock->stat != NULL)
+    wait_start = clock_ns ();
+#endif
+  if (lock->holder != NULL && !thread_mlfqs) 
+    {
+      cur->waiting_lock = lock;
+      donate_priority (lock);
+    }
   sema_down (&lock->semaphore);
-  lock->holder = thread_current ();
+  cur->waiting_lock = NULL;
+  lock->holder = cur;
+  list_push_back (&cur->held_locks, &lock->elem);
+#ifdef LOCKSTAT
+  lockstat_acquired (lock->stat, contended, wait_start);
+  if (lock->stat != NULL)
+    lock->acquire_ns = clock_ns ();
+#endif
+  spinlock_release (&sched_lock);
 }
 
 /* Tries to acquires LOCK and returns true if successful or false
@@ -214,13 +442,84 @@ lock_try_acquire (struct lock *lock)
   ASSERT (lock != NULL);
   ASSERT (!lock_held_by_current_thread (lock));
 
+  spinlock_acquire (&sched_lock);
   success = sema_try_down (&lock->semaphore);
   if (success)
-    lock->holder = thread_current ();
+    {
+      lock->holder = thread_current ();
+      list_push_back (&lock->holder->held_locks, &lock->elem);
+#ifdef LOCKSTAT
+      lockstat_acquired (lock->stat, false, 0);
+      if (lock->stat != NULL)
+        lock->acquire_ns = clock_ns ();
+#endif
+    }
+  spinlock_release (&sched_lock);
+  return success;
+}
+
+/* Acquires LOCK like lock_acquire(), but gives up after TICKS
+   timer ticks.  Returns true if successful, false if the timeout
+   expired first, in which case any priority donated to the
+   holder of LOCK while waiting is withdrawn.  If TICKS is 0 or
+   less, this is the same as lock_try_acquire().
+
+   This function may sleep, so it must not be called within an
+   interrupt handler. */
+bool
+lock_acquire_timeout (struct lock *lock, int64_t ticks) 
+{
+  struct thread *cur = thread_current ();
+  enum intr_level old_level;
+  bool success;
+#ifdef LOCKSTAT
+  bool contended;
+  uint64_t wait_start = 0;
+#endif
+
+  ASSERT (lock != NULL);
+  ASSERT (!intr_context ());
+  ASSERT (!lock_held_by_current_thread (lock));
+
+  if (ticks <= 0)
+    return lock_try_acquire (lock);
+
+  old_level = intr_disable ();
+  spinlock_acquire (&sched_lock);
+#ifdef LOCKSTAT
+  contended = lock->holder != NULL;
+  if (contended && lock->stat != NULL)
+    wait_start = clock_ns ();
+#endif
+  if (lock->holder != NULL && !thread_mlfqs) 
+    {
+      cur->waiting_lock = lock;
+      donate_priority (lock);
+    }
+  success = sema_down_timeout (&lock->semaphore, ticks);
+  cur->waiting_lock = NULL;
+  if (success) 
+    {
+      lock->holder = cur;
+      list_push_back (&cur->held_locks, &lock->elem);
+#ifdef LOCKSTAT
+      lockstat_acquired (lock->stat, contended, wait_start);
+      if (lock->stat != NULL)
+        lock->acquire_ns = clock_ns ();
+#endif
+    }
+  else
+    withdraw_donation (lock);
+  spinlock_release (&sched_lock);
+  intr_set_level (old_level);
+
+  thread_preempt ();
   return success;
 }
 
 /* Releases LOCK, which must be owned by the current thread.
+   Withdraws any priority donated to the current thread by
+   threads waiting for LOCK, which may cause it to yield.
 
    An interrupt handler cannot acquire a lock, so it does not
    make sense to try to release a lock within an interrupt
@@ -228,11 +527,28 @@ lock_try_acquire (struct lock *lock)
 void
 lock_release (struct lock *lock) 
 {
+  struct thread *cur = thread_current ();
+
   ASSERT (lock != NULL);
   ASSERT (lock_held_by_current_thread (lock));
 
+  spinlock_acquire (&sched_lock);
+#ifdef LOCKSTAT
+  if (lock->stat != NULL) 
+    {
+      uint64_t held = clock_ns () - lock->acquire_ns;
+      lock->stat->hold_ns += held;
+      if (held > lock->stat->max_hold_ns)
+        lock->stat->max_hold_ns = held;
+    }
+#endif
   lock->holder = NULL;
+  list_remove (&lock->elem);
+  thread_update_priority (cur);
   sema_up (&lock->semaphore);
+  spinlock_release (&sched_lock);
+
+  thread_preempt ();
 }
 
 /* Returns true if the current thread holds LOCK, false
@@ -246,13 +562,73 @@ lock_held_by_current_thread (const struct lock *lock)
   return lock->holder == thread_current ();
 }
 
+/* Donates the running thread's priority to the holder of LOCK,
+   which the running thread is about to wait for, and onward
+   along the chain of lock holders that are themselves waiting
+   for locks, to a depth of at most DONATION_DEPTH_MAX.  The
+   caller must hold sched_lock. */
+static void
+donate_priority (struct lock *lock) 
+{
+  int priority = thread_current ()->priority;
+  int depth;
+
+  ASSERT (spinlock_held_by_current_cpu (&sched_lock));
+
+  for (depth = 0; lock != NULL && depth < DONATION_DEPTH_MAX; depth++)
+    {
+      struct thread *holder = lock->holder;
+      if (holder == NULL || holder->priority >= priority)
+        break;
+      thread_donate_priority (holder, priority);
+      lock = holder->waiting_lock;
+    }
+}
+
+/* Recomputes the priority of the holder of LOCK, which the
+   running thread has stopped waiting for, and of the holders of
+   the locks that holder is itself waiting for, to a depth of at
+   most DONATION_DEPTH_MAX, so that they no longer carry the
+   running thread's donation.  The caller must hold sched_lock. */
+static void
+withdraw_donation (struct lock *lock) 
+{
+  int depth;
+
+  ASSERT (spinlock_held_by_current_cpu (&sched_lock));
+
+  for (depth = 0; lock != NULL && depth < DONATION_DEPTH_MAX; depth++)
+    {
+      struct thread *holder = lock->holder;
+      if (holder == NULL)
+        break;
+      thread_update_priority (holder);
+      lock = holder->waiting_lock;
+    }
+}
+
+/* Returns true if thread A has lower priority than thread B,
+   false otherwise. */
+static bool
+thread_priority_less (const struct list_elem *a_,
+                      const struct list_elem *b_, void *aux UNUSED) 
+{
+  const struct thread *a = list_entry (a_, struct thread, elem);
+  const struct thread *b = list_entry (b_, struct thread, elem);
+
+  return a->priority < b->priority;
+}
+
 /* One semaphore in a list. */
 struct semaphore_elem 
   {
     struct list_elem elem;              /* List element. */
     struct semaphore semaphore;         /* This semaphore. */
+    struct thread *thread;              /* Thread waiting on it. */
   };
 
+static list_less_func waiter_priority_less;
+
 /* Initializes condition variable COND.  A condition variable
    allows one piece of code to signal a condition and cooperating
    code to receive the signal and act upon it. */
@@ -295,6 +671,7 @@ cond_wait (struct condition *cond, struct lock *lock)
   ASSERT (lock_held_by_current_thread (lock));
   
   sema_init (&waiter.semaphore, 0);
+  waiter.thread = thread_current ();
   list_push_back (&cond->waiters, &waiter.elem);
   lock_release (lock);
   sema_down (&waiter.semaphore);
@@ -302,8 +679,9 @@ cond_wait (struct condition *cond, struct lock *lock)
 }
 
 /* If any threads are waiting on COND (protected by LOCK), then
-   this function signals one of them to wake up from its wait.
-   LOCK must be held before calling this function.
+   this function signals the highest-priority one of them to wake
+   up from its wait.  LOCK must be held before calling this
+   function.
 
    An interrupt handler cannot acquire a lock, so it does not
    make sense to try to signal a condition variable within an
@@ -317,8 +695,12 @@ cond_signal (struct condition *cond, struct lock *lock UNUSED)
   ASSERT (lock_held_by_current_thread (lock));
 
   if (!list_empty (&cond->waiters)) 
-    sema_up (&list_entry (list_pop_front (&cond->waiters),
-                          struct semaphore_elem, elem)->semaphore);
+    {
+      struct list_elem *e = list_max (&cond->waiters,
+                                      waiter_priority_less, NULL);
+      list_remove (e);
+      sema_up (&list_entry (e, struct semaphore_elem, elem)->semaphore);
+    }
 }
 
 /* Wakes up all threads, if any, waiting on COND (protected by
@@ -336,3 +718,496 @@ cond_broadcast (struct condition *cond, struct lock *lock)
   while (!list_empty (&cond->waiters))
     cond_signal (cond, lock);
 }
+
+/* Returns true if the thread waiting on semaphore_elem A has
+   lower priority than the one waiting on B, false otherwise. */
+static bool
+waiter_priority_less (const struct list_elem *a_,
+                      const struct list_elem *b_, void *aux UNUSED) 
+{
+  const struct semaphore_elem *a
+    = list_entry (a_, struct semaphore_elem, elem);
+  const struct semaphore_elem *b
+    = list_entry (b_, struct semaphore_elem, elem);
+
+  return a->thread->priority < b->thread->priority;
+}
+
+/* Initializes RW as a readers-writer lock.  Any number of
+   readers may hold RW at once, or a single writer.
+
+   RW is writer-preferring: once a writer starts waiting, new
+   readers wait behind it, so that a stream of readers cannot
+   starve writers.  The writer holds RW's internal lock for as
+   long as it holds RW, and readers briefly acquire the same lock
+   on the way in, so a thread waiting for RW donates its priority
+   to the writer holding or waiting for it, just as for a lock.
+   Priority is not donated to readers, because the lock does not
+   track which threads they are.
+
+   A reader must not try to acquire RW again while holding it,
+   because it could deadlock with a waiting writer. */
+void
+rwlock_init (struct rwlock *rw) 
+{
+  ASSERT (rw != NULL);
+
+  lock_init (&rw->lock);
+  rw->readers = 0;
+  rw->writer_waiting = false;
+  sema_init (&rw->drained, 0);
+}
+
+/* Initializes RW, like rwlock_init().  In a LOCKSTAT kernel,
+   RW's statistics are kept under NAME and INDEX, which may be -1
+   if NAME alone identifies RW. */
+void
+rwlock_init_named (struct rwlock *rw, const char *name UNUSED,
+                   int index UNUSED) 
+{
+#ifdef LOCKSTAT
+  rwlock_init_stat (rw, name, index);
+#else
+  rwlock_init (rw);
+#endif
+}
+
+/* Acquires RW for reading, sleeping until no writer holds it or
+   is waiting for it. */
+void
+rwlock_acquire_read (struct rwlock *rw) 
+{
+  ASSERT (rw != NULL);
+
+  lock_acquire (&rw->lock);
+  spinlock_acquire (&sched_lock);
+  rw->readers++;
+  spinlock_release (&sched_lock);
+  lock_release (&rw->lock);
+}
+
+/* Releases RW, which the current thread holds for reading.
+   If this is the last reader and a writer is waiting, wakes the
+   writer. */
+void
+rwlock_release_read (struct rwlock *rw) 
+{
+  ASSERT (rw != NULL);
+
+  spinlock_acquire (&sched_lock);
+  ASSERT (rw->readers > 0);
+  if (--rw->readers == 0 && rw->writer_waiting) 
+    {
+      rw->writer_waiting = false;
+      sema_up (&rw->drained);
+    }
+  spinlock_release (&sched_lock);
+  thread_preempt ();
+}
+
+/* Acquires RW for writing, sleeping until no other writer holds
+   it and all the readers that hold it have released it.  New
+   readers are kept out while we wait. */
+void
+rwlock_acquire_write (struct rwlock *rw) 
+{
+  ASSERT (rw != NULL);
+
+  lock_acquire (&rw->lock);
+  spinlock_acquire (&sched_lock);
+  if (rw->readers > 0) 
+    {
+      rw->writer_waiting = true;
+      sema_down (&rw->drained);
+    }
+  spinlock_release (&sched_lock);
+}
+
+/* Releases RW, which the current thread holds for writing. */
+void
+rwlock_release_write (struct rwlock *rw) 
+{
+  ASSERT (rw != NULL);
+  ASSERT (rwlock_held_for_write (rw));
+
+  lock_release (&rw->lock);
+}
+
+/* Returns true if the current thread holds RW for writing,
+   false otherwise. */
+bool
+rwlock_held_for_write (const struct rwlock *rw) 
+{
+  ASSERT (rw != NULL);
+
+  return lock_held_by_current_thread (&rw->lock) && rw->readers == 0;
+}
+
+/* Initializes SL as a spin lock that no CPU holds. */
+void
+spinlock_init (struct spinlock *sl) 
+{
+  ASSERT (sl != NULL);
+
+  sl->locked = 0;
+  sl->cpu = NULL;
+  sl->depth = 0;
+  sl->old_level = INTR_OFF;
+}
+
+/* Turns off interrupts on this CPU and returns the previous
+   interrupt status.  Unlike intr_disable(), does not take the
+   interrupt lock, which must never be waited for while holding a
+   spin lock. */
+static enum intr_level
+cli_save (void) 
+{
+  enum intr_level old_level = intr_get_level ();
+  asm volatile ("cli" : : : "memory");
+  return old_level;
+}
+
+/* Atomically stores 1 in SL's lock word and returns its old
+   value.  See [IA32-v2b] "XCHG". */
+static uint32_t
+test_and_set (struct spinlock *sl) 
+{
+  uint32_t old = 1;
+  asm volatile ("xchgl %0, %1" : "+r" (old), "+m" (sl->locked) : : "memory");
+  return old;
+}
+
+/* Acquires SL, spinning until it becomes available if
+   necessary, with interrupts off on this CPU until the matching
+   spinlock_release().  If this CPU already holds SL, just counts
+   the acquisition.
+
+   This function does not sleep, so it may be called within an
+   interrupt handler. */
+void
+spinlock_acquire (struct spinlock *sl) 
+{
+  enum intr_level old_level;
+  struct cpu *c;
+
+  ASSERT (sl != NULL);
+
+  old_level = cli_save ();
+  c = cpu_current ();
+  if (sl->cpu == c) 
+    {
+      sl->depth++;
+      return;
+    }
+
+  while (test_and_set (sl) != 0)
+    while (sl->locked)
+      asm volatile ("pause" : : : "memory");
+  sl->cpu = c;
+  sl->depth = 1;
+  sl->old_level = old_level;
+}
+
+/* Acquires SL if no other CPU holds it, without spinning.
+   Returns true if successful, false if another CPU holds SL. */
+bool
+spinlock_try_acquire (struct spinlock *sl) 
+{
+  enum intr_level old_level;
+  struct cpu *c;
+
+  ASSERT (sl != NULL);
+
+  old_level = cli_save ();
+  c = cpu_current ();
+  if (sl->cpu == c) 
+    {
+      sl->depth++;
+      return true;
+    }
+  if (test_and_set (sl) != 0) 
+    {
+      if (old_level == INTR_ON)
+        intr_enable ();
+      return false;
+    }
+  sl->cpu = c;
+  sl->depth = 1;
+  sl->old_level = old_level;
+  return true;
+}
+
+/* Releases SL, which this CPU must hold.  If this matches the
+   first acquisition, makes SL available to other CPUs and
+   restores the interrupt status from before that acquisition. */
+void
+spinlock_release (struct spinlock *sl) 
+{
+  enum intr_level old_level;
+
+  ASSERT (spinlock_held_by_current_cpu (sl));
+
+  if (--sl->depth > 0)
+    return;
+
+  old_level = sl->old_level;
+  sl->cpu = NULL;
+  barrier ();
+  sl->locked = 0;
+  if (old_level == INTR_ON)
+    intr_enable ();
+}
+
+/* Returns true if the current CPU holds SL, false otherwise. */
+bool
+spinlock_held_by_current_cpu (const struct spinlock *sl) 
+{
+  ASSERT (sl != NULL);
+
+  return (intr_get_level () == INTR_OFF && sl->depth > 0
+          && sl->cpu == cpu_current ());
+}
+
+/* Initializes SL as a sequence lock. */
+void
+seqlock_init (struct seqlock *sl) 
+{
+  ASSERT (sl != NULL);
+
+  sl->seq = 0;
+}
+
+/* Begins a read of the data protected by SL.  Returns a value
+   to pass to seqlock_read_retry() after reading the data.
+
+   Writers run with interrupts off, so a reader on the writer's
+   CPU cannot find a write half done here, but a reader on
+   another CPU can, and waits for the write to finish.  A write
+   that comes between this call and seqlock_read_retry() is
+   detected there.  Compiler barriers are enough to order the
+   accesses, because x86 CPUs do not reorder loads with other
+   loads or stores with other stores. */
+unsigned
+seqlock_read_begin (const struct seqlock *sl) 
+{
+  unsigned seq;
+
+  while ((seq = sl->seq) & 1)
+    asm volatile ("pause" : : : "memory");
+  barrier ();
+  return seq;
+}
+
+/* Returns true if the data protected by SL may have changed
+   since the seqlock_read_begin() that returned START, in which
+   case the reader must discard what it read and try again. */
+bool
+seqlock_read_retry (const struct seqlock *sl, unsigned start) 
+{
+  barrier ();
+  return sl->seq != start;
+}
+
+/* Begins a write of the data protected by SL.  Interrupts must
+   be off. */
+void
+seqlock_write_begin (struct seqlock *sl) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (!(sl->seq & 1));
+
+  sl->seq++;
+  barrier ();
+}
+
+/* Ends a write of the data protected by SL. */
+void
+seqlock_write_end (struct seqlock *sl) 
+{
+  ASSERT (sl->seq & 1);
+
+  barrier ();
+  sl->seq++;
+}
+
+#ifdef LOCKSTAT
+/* Initializes SEMA to VALUE, like sema_init(), and keeps
+   statistics for it under NAME and INDEX. */
+void
+sema_init_stat (struct semaphore *sema, unsigned value,
+                const char *name, int index) 
+{
+  sema_init (sema, value);
+  sema->stat = lockstat_get (name, index, NULL, 0);
+}
+
+/* Initializes SEMA to VALUE, like sema_init(), and keeps
+   statistics for it with those of every object initialized at
+   SITE. */
+void
+sema_init_site (struct semaphore *sema, unsigned value,
+                struct lockstat_site *site) 
+{
+  sema_init (sema, value);
+  sema->stat = lockstat_get_site (site);
+}
+
+/* Initializes LOCK, like lock_init(), and keeps statistics for
+   it as described for sema_init_stat(). */
+void
+lock_init_stat (struct lock *lock, const char *name, int index) 
+{
+  lock_init (lock);
+  lock->stat = lockstat_get (name, index, NULL, 0);
+}
+
+/* Initializes LOCK, like lock_init(), and keeps statistics for
+   it as described for sema_init_site(). */
+void
+lock_init_site (struct lock *lock, struct lockstat_site *site) 
+{
+  lock_init (lock);
+  lock->stat = lockstat_get_site (site);
+}
+
+/* Initializes RW, like rwlock_init(), and keeps statistics for
+   its internal lock as described for sema_init_stat().  Readers
+   and writers both count as acquisitions. */
+void
+rwlock_init_stat (struct rwlock *rw, const char *name, int index) 
+{
+  rwlock_init (rw);
+  rw->lock.stat = lockstat_get (name, index, NULL, 0);
+}
+
+/* Initializes RW, like rwlock_init(), and keeps statistics for
+   its internal lock as described for sema_init_site(). */
+void
+rwlock_init_site (struct rwlock *rw, struct lockstat_site *site) 
+{
+  rwlock_init (rw);
+  rw->lock.stat = lockstat_get_site (site);
+}
+
+/* Prints the TOP locks with the most contended acquisitions. */
+void
+lockstat_print (int top) 
+{
+  struct list_elem *e;
+  int i;
+
+  spinlock_acquire (&sched_lock);
+  list_sort (&lockstat_list, lockstat_less, NULL);
+  spinlock_release (&sched_lock);
+
+  printf ("Lockstat: %10s %10s %12s %10s %12s %10s  %s\n",
+          "acquired", "contended", "wait (ns)", "max", "hold (ns)", "max",
+          "lock");
+  for (e = list_begin (&lockstat_list), i = 0;
+       e != list_end (&lockstat_list) && i < top;
+       e = list_next (e), i++) 
+    {
+      struct lockstat *s = list_entry (e, struct lockstat, elem);
+      printf ("Lockstat: %10lld %10lld %12"PRIu64" %10"PRIu64
+              " %12"PRIu64" %10"PRIu64"  %s",
+              s->acquired, s->contended, s->wait_ns, s->max_wait_ns,
+              s->hold_ns, s->max_hold_ns, s->name);
+      if (s->file != NULL)
+        printf (" (%s:%d)\n", s->file, s->line);
+      else if (s->index >= 0)
+        printf ("[%d]\n", s->index);
+      else
+        printf ("\n");
+    }
+  if (lockstat_dropped > 0)
+    printf ("Lockstat: %lld locks not tracked, table full\n",
+            lockstat_dropped);
+}
+
+/* Returns the struct lockstat for NAME and INDEX, and for an
+   unnamed object also source location FILE and LINE, creating
+   it if it does not yet exist.  Returns a null pointer if a new
+   one is needed but the table is full. */
+static struct lockstat *
+lockstat_get (const char *name, int index, const char *file, int line) 
+{
+  struct lockstat *s = NULL;
+  struct list_elem *e;
+
+  spinlock_acquire (&sched_lock);
+  for (e = list_begin (&lockstat_list); e != list_end (&lockstat_list);
+       e = list_next (e)) 
+    {
+      struct lockstat *t = list_entry (e, struct lockstat, elem);
+      if (t->index == index && t->line == line
+          && (t->file == NULL ? file == NULL
+              : file != NULL && !strcmp (t->file, file))
+          && !strcmp (t->name, name)) 
+        {
+          s = t;
+          break;
+        }
+    }
+  if (s == NULL && lockstat_cnt < LOCKSTAT_MAX) 
+    {
+      s = &lockstats[lockstat_cnt++];
+      s->name = name;
+      s->index = index;
+      s->file = file;
+      s->line = line;
+      list_push_back (&lockstat_list, &s->elem);
+    }
+  else if (s == NULL)
+    lockstat_dropped++;
+  spinlock_release (&sched_lock);
+
+  return s;
+}
+
+/* Returns the struct lockstat shared by the objects initialized
+   at SITE, looking it up only the first time.  Returns a null
+   pointer if the table is full. */
+static struct lockstat *
+lockstat_get_site (struct lockstat_site *site) 
+{
+  if (site->stat == NULL)
+    site->stat = lockstat_get (site->name, -1, site->file, site->line);
+  return site->stat;
+}
+
+/* Records an acquisition in STAT, if it is nonnull.  If
+   CONTENDED, the acquirer had to wait, starting at WAIT_START as
+   returned by clock_ns().  The caller must hold sched_lock. */
+static void
+lockstat_acquired (struct lockstat *stat, bool contended,
+                   uint64_t wait_start) 
+{
+  ASSERT (spinlock_held_by_current_cpu (&sched_lock));
+
+  if (stat == NULL)
+    return;
+  stat->acquired++;
+  if (contended) 
+    {
+      uint64_t wait = clock_ns () - wait_start;
+      stat->contended++;
+      stat->wait_ns += wait;
+      if (wait > stat->max_wait_ns)
+        stat->max_wait_ns = wait;
+    }
+}
+
+/* Orders lockstats by decreasing number of contended
+   acquisitions, then by decreasing wait time. */
+static bool
+lockstat_less (const struct list_elem *a_, const struct list_elem *b_,
+               void *aux UNUSED) 
+{
+  const struct lockstat *a = list_entry (a_, struct lockstat, elem);
+  const struct lockstat *b = list_entry (b_, struct lockstat, elem);
+
+  if (a->contended != b->contended)
+    return a->contended > b->contended;
+  return a->wait_ns > b->wait_ns;
+}
+#endif /* LOCKSTAT */
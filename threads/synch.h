@@ -3,30 +3,94 @@
 
 #include <list.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include "threads/interrupt.h"
+
+struct cpu;
+
+#ifdef LOCKSTAT
+/* Contention statistics, kept when the kernel is built with
+   LOCKSTAT defined (e.g. "make LOCKSTAT=1").
+
+   A lock or semaphore initialized with lock_init_named() or the
+   like is counted under its name and index, so that, say, each
+   malloc() descriptor has its own entry.  Objects initialized
+   with the same name and index share an entry.  One initialized
+   with plain lock_init() or the like shares an entry with every
+   object initialized at the same place in the source, which
+   suits short-lived objects such as semaphores on the stack.
+   Times are in nanoseconds. */
+struct lockstat 
+  {
+    const char *name;           /* Name, or expression initialized. */
+    int index;                  /* Index within NAME, or -1. */
+    const char *file;           /* Source file, for unnamed objects. */
+    int line;                   /* Source line, for unnamed objects. */
+    struct list_elem elem;      /* Element in list of all lockstats. */
+
+    long long acquired;         /* # of acquisitions. */
+    long long contended;        /* # of acquisitions that had to wait. */
+    uint64_t wait_ns;           /* Total time spent waiting. */
+    uint64_t max_wait_ns;       /* Longest wait. */
+    uint64_t hold_ns;           /* Total time held (locks only). */
+    uint64_t max_hold_ns;       /* Longest hold (locks only). */
+  };
+
+/* The place in the source where unnamed objects are initialized,
+   and the struct lockstat they share, found the first time an
+   object is initialized there. */
+struct lockstat_site 
+  {
+    const char *name;           /* Expression initialized. */
+    const char *file;           /* Source file. */
+    int line;                   /* Source line. */
+    struct lockstat *stat;      /* Statistics, or null if not yet found. */
+  };
+
+/* Number of locks that lockstat_print() prints at
+   shutdown, or 0 not to print any.
+   Controlled by kernel command-line option "-lockstat=N". */
+extern int lockstat_top;
+
+void lockstat_print (int top);
+#endif
 
 /* A counting semaphore. */
 struct semaphore 
   {
     unsigned value;             /* Current value. */
     struct list waiters;        /* List of waiting threads. */
+#ifdef LOCKSTAT
+    struct lockstat *stat;      /* Statistics, or a null pointer. */
+#endif
   };
 
 void sema_init (struct semaphore *, unsigned value);
+void sema_init_named (struct semaphore *, unsigned value,
+                      const char *name, int index);
 void sema_down (struct semaphore *);
 bool sema_try_down (struct semaphore *);
+bool sema_down_timeout (struct semaphore *, int64_t ticks);
 void sema_up (struct semaphore *);
 void sema_self_test (void);
 
 /* Lock. */
 struct lock 
   {
-    struct thread *holder;      /* Thread holding lock (for debugging). */
+    struct thread *holder;      /* Thread holding lock. */
     struct semaphore semaphore; /* Binary semaphore controlling access. */
+    struct list_elem elem;      /* Element in holder's `held_locks'. */
+#ifdef LOCKSTAT
+    struct lockstat *stat;      /* Statistics, or a null pointer. */
+    uint64_t acquire_ns;        /* When holder acquired it. */
+#endif
   };
 
 void lock_init (struct lock *);
+void lock_init_named (struct lock *, const char *name, int index);
 void lock_acquire (struct lock *);
 bool lock_try_acquire (struct lock *);
+bool lock_acquire_timeout (struct lock *, int64_t ticks);
 void lock_release (struct lock *);
 bool lock_held_by_current_thread (const struct lock *);
 
@@ -41,6 +105,109 @@ void cond_wait (struct condition *, struct lock *);
 void cond_signal (struct condition *, struct lock *);
 void cond_broadcast (struct condition *, struct lock *);
 
+/* Readers-writer lock. */
+struct rwlock 
+  {
+    struct lock lock;           /* Held by writer, briefly by readers. */
+    unsigned readers;           /* Number of readers holding the lock. */
+    bool writer_waiting;        /* Writer waiting for readers to leave? */
+    struct semaphore drained;   /* Upped when the last reader leaves. */
+  };
+
+void rwlock_init (struct rwlock *);
+void rwlock_init_named (struct rwlock *, const char *name, int index);
+void rwlock_acquire_read (struct rwlock *);
+void rwlock_release_read (struct rwlock *);
+void rwlock_acquire_write (struct rwlock *);
+void rwlock_release_write (struct rwlock *);
+bool rwlock_held_for_write (const struct rwlock *);
+
+/* Spin lock.
+
+   Protects data shared between CPUs for short stretches of code
+   that must not sleep.  Acquiring a spin lock turns off
+   interrupts on the acquiring CPU, so that an interrupt handler
+   cannot spin forever on a lock that the code it interrupted
+   holds, and releasing it restores the interrupt level that was
+   in effect before.
+
+   A spin lock belongs to the CPU that holds it, not to a thread,
+   and that CPU may acquire it again without waiting, as long as
+   it releases it as many times.  The scheduler lock (see
+   thread.h) relies on this, because it stays held across a
+   thread switch.
+
+   Where code needs both, the interrupt lock that intr_disable()
+   takes with more than one CPU running (see interrupt.c) must be
+   acquired before any spin lock, never while holding one. */
+struct spinlock 
+  {
+    volatile uint32_t locked;   /* 1 if held, 0 if free. */
+    struct cpu *cpu;            /* CPU holding the lock, if any. */
+    unsigned depth;             /* Number of times acquired by CPU. */
+    enum intr_level old_level;  /* Level before first acquisition. */
+  };
+
+void spinlock_init (struct spinlock *);
+void spinlock_acquire (struct spinlock *);
+bool spinlock_try_acquire (struct spinlock *);
+void spinlock_release (struct spinlock *);
+bool spinlock_held_by_current_cpu (const struct spinlock *);
+
+/* Sequence lock.
+
+   Protects a small piece of data that is read much more often
+   than it is written, such as a counter, without making readers
+   write anything or turn off interrupts.  A reader notes the
+   sequence number, reads the data, and tries again if the
+   sequence number changed meanwhile.  Writers must already be
+   serialized with each other, e.g. by the interrupt lock that
+   intr_disable() takes, and must not be interrupted by a reader
+   on their own CPU, so they run with interrupts off. */
+struct seqlock 
+  {
+    volatile unsigned seq;      /* Odd while a write is in progress. */
+  };
+
+void seqlock_init (struct seqlock *);
+unsigned seqlock_read_begin (const struct seqlock *);
+bool seqlock_read_retry (const struct seqlock *, unsigned start);
+void seqlock_write_begin (struct seqlock *);
+void seqlock_write_end (struct seqlock *);
+
+#ifdef LOCKSTAT
+/* Passes each initialization's name and index, or for unnamed
+   objects a struct lockstat_site private to the place in the
+   source where they are initialized, along to the function that
+   finds its struct lockstat.  Code that calls the functions
+   directly, such as synch.c itself, keeps no statistics. */
+#define LOCKSTAT_SITE(NAME)                                             \
+        ({ static struct lockstat_site site_                            \
+             = {NAME, __FILE__, __LINE__, NULL};                        \
+           &site_; })
+#define sema_init(SEMA, VALUE) \
+        sema_init_site (SEMA, VALUE, LOCKSTAT_SITE (#SEMA))
+#define sema_init_named(SEMA, VALUE, NAME, INDEX) \
+        sema_init_stat (SEMA, VALUE, NAME, INDEX)
+#define lock_init(LOCK) \
+        lock_init_site (LOCK, LOCKSTAT_SITE (#LOCK))
+#define lock_init_named(LOCK, NAME, INDEX) \
+        lock_init_stat (LOCK, NAME, INDEX)
+#define rwlock_init(RW) \
+        rwlock_init_site (RW, LOCKSTAT_SITE (#RW))
+#define rwlock_init_named(RW, NAME, INDEX) \
+        rwlock_init_stat (RW, NAME, INDEX)
+
+void sema_init_stat (struct semaphore *, unsigned value,
+                     const char *name, int index);
+void sema_init_site (struct semaphore *, unsigned value,
+                     struct lockstat_site *);
+void lock_init_stat (struct lock *, const char *name, int index);
+void lock_init_site (struct lock *, struct lockstat_site *);
+void rwlock_init_stat (struct rwlock *, const char *name, int index);
+void rwlock_init_site (struct rwlock *, struct lockstat_site *);
+#endif
+
 /* Optimization barrier.
 
    The compiler will not reorder operations across an
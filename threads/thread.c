@@ -1,9 +1,16 @@
 #include "threads/thread.h"
 #include <debug.h>
+#include <histogram.h>
+#include <inttypes.h>
 #include <stddef.h>
 #include <random.h>
+#include <round.h>
 #include <stdio.h>
 #include <string.h>
+#include "devices/clock.h"
+#include "devices/timer.h"
+#include "threads/cpu.h"
+#include "threads/fixed-point.h"
 #include "threads/flags.h"
 #include "threads/interrupt.h"
 #include "threads/intr-stubs.h"
@@ -20,17 +27,21 @@
    of thread.h for details. */
 #define THREAD_MAGIC 0xcd6abf4b
 
-/* List of processes in THREAD_READY state, that is, processes
-   that are ready to run but not actually running. */
-static struct list ready_list;
+/* Each CPU has a run queue of processes in THREAD_READY state,
+   that is, processes that are ready to run but not actually
+   running, in its struct cpu (see cpu.h).  There is one FIFO
+   list per priority, and bit P of ready_map is set if and only
+   if ready_lists[P] is nonempty, so that both adding a thread
+   and finding the highest-priority ready thread take constant
+   time regardless of the number of threads.
+
+   See thread.h for sched_lock, which protects the run queues. */
+struct spinlock sched_lock;
 
 /* List of all processes.  Processes are added to this list
    when they are first scheduled and removed when they exit. */
 static struct list all_list;
 
-/* Idle thread. */
-static struct thread *idle_thread;
-
 /* Initial thread, the thread running init.c:main(). */
 static struct thread *initial_thread;
 
@@ -45,25 +56,78 @@ struct kernel_thread_frame
     void *aux;                  /* Auxiliary data for function. */
   };
 
-/* Statistics. */
-static long long idle_ticks;    /* # of timer ticks spent idle. */
-static long long kernel_ticks;  /* # of timer ticks in kernel threads. */
-static long long user_ticks;    /* # of timer ticks in user programs. */
-
-/* Scheduling. */
+/* Scheduler statistics, kept only if thread_schedstat is true. */
+static struct histogram latency_hist; /* Nanoseconds from ready to running. */
+static struct histogram slice_hist;   /* Nanoseconds run before switching out. */
+static struct histogram runq_hist;    /* Run queue length at switches. */
+static long long voluntary_switches;  /* Switches due to block or yield. */
+static long long involuntary_switches; /* Switches due to preemption. */
+
+/* Free pages of exited threads, kept for reuse by
+   thread_create().  Protected by sched_lock. */
+static struct list thread_cache;
+static size_t thread_cache_cnt; /* Number of pages in thread_cache. */
+
+/* Scheduling.  Each CPU counts the ticks its running thread has
+   run in thread_ticks, and sets `preempting' just before a yield
+   that preempts the running thread, as opposed to one it makes
+   of its own accord; schedule() clears it. */
 #define TIME_SLICE 4            /* # of timer ticks to give each thread. */
-static unsigned thread_ticks;   /* # of timer ticks since last yield. */
+
+/* Load balancing.  A thread that was switched out fewer than
+   CACHE_HOT_TICKS ago probably still has data in the cache of
+   the CPU it ran on, so it is not moved to another CPU. */
+#define CACHE_HOT_TICKS 2
 
 /* If false (default), use round-robin scheduler.
    If true, use multi-level feedback queue scheduler.
    Controlled by kernel command-line option "-o mlfqs". */
 bool thread_mlfqs;
 
+/* If false (default), keep no scheduler statistics.
+   If true, keep them and print them at shutdown.
+   Controlled by kernel command-line option "-schedstat". */
+bool thread_schedstat;
+
+/* Maximum number of exited threads' pages to keep for reuse by
+   thread_create().  0 disables the cache.
+   Controlled by kernel command-line option "-threadcache=N". */
+size_t thread_cache_max = THREAD_CACHE_MAX;
+
+/* Multi-level feedback queue scheduler.  Estimated average
+   number of threads ready to run over the past minute. */
+#define MLFQS_PRIORITY_TICKS 4  /* # of ticks between priority updates. */
+static fixed_point load_avg;
+
 static void kernel_thread (thread_func *, void *aux);
 
 static void idle (void *aux UNUSED);
+static void idle_loop (void) NO_RETURN;
 static struct thread *running_thread (void);
-static struct thread *next_thread_to_run (void);
+static bool is_idle (const struct thread *);
+static struct thread *next_thread_to_run (struct cpu *);
+static struct cpu *select_cpu (const struct thread *);
+static struct thread *steal_thread (struct cpu *);
+static bool is_cache_hot (const struct thread *);
+static int cpu_load (const struct cpu *);
+static void cpu_kick (struct cpu *, const struct thread *);
+static void ready_push (struct cpu *, struct thread *);
+static void ready_remove (struct thread *);
+static void change_priority (struct thread *, int priority);
+static void mlfqs_tick (struct cpu *, struct thread *);
+static int mlfqs_priority (const struct thread *);
+static void mlfqs_update_priority (struct thread *);
+static void mlfqs_update_recent_cpu (struct thread *, void *coef);
+static int ready_max_priority (const struct cpu *);
+static void take_intr_lock (void);
+static uint64_t account_run_time (struct cpu *, struct thread *);
+static void schedstat_switch_out (struct cpu *, struct thread *,
+                                  uint64_t ran_ns);
+static void schedstat_switch_in (struct thread *);
+static void schedstat_print (void);
+static struct thread *thread_page_get (void);
+static void thread_page_free (struct thread *);
+static palloc_reclaim_func thread_cache_reclaim;
 static void init_thread (struct thread *, const char *name, int priority);
 static bool is_thread (struct thread *) UNUSED;
 static void *alloc_frame (struct thread *, size_t size);
@@ -76,7 +140,7 @@ static tid_t allocate_tid (void);
    general and it is possible in this case only because loader.S
    was careful to put the bottom of the stack at a page boundary.
 
-   Also initializes the run queue and the tid lock.
+   Also initializes the run queues and the tid lock.
 
    After calling this function, be sure to initialize the page
    allocator before trying to create any threads with
@@ -87,17 +151,26 @@ static tid_t allocate_tid (void);
 void
 thread_init (void) 
 {
+  int i, j;
+
   ASSERT (intr_get_level () == INTR_OFF);
 
+  spinlock_init (&sched_lock);
   lock_init (&tid_lock);
-  list_init (&ready_list);
+  for (i = 0; i < CPU_MAX; i++)
+    for (j = 0; j < PRI_CNT; j++)
+      list_init (&cpus[i].ready_lists[j]);
   list_init (&all_list);
+  list_init (&thread_cache);
+  palloc_add_reclaimer (thread_cache_reclaim, false);
 
   /* Set up a thread structure for the running thread. */
   initial_thread = running_thread ();
   init_thread (initial_thread, "main", PRI_DEFAULT);
   initial_thread->status = THREAD_RUNNING;
   initial_thread->tid = allocate_tid ();
+  initial_thread->cpu = &cpus[0];
+  cpus[0].running = initial_thread;
 }
 
 /* Starts preemptive thread scheduling by enabling interrupts.
@@ -113,38 +186,128 @@ thread_start (void)
   /* Start preemptive thread scheduling. */
   intr_enable ();
 
-  /* Wait for the idle thread to initialize idle_thread. */
+  /* Wait for the idle thread to initialize the BSP's
+     idle_thread. */
   sema_down (&idle_started);
 }
 
-/* Called by the timer interrupt handler at each timer tick.
-   Thus, this function runs in an external interrupt context. */
+/* Creates the idle thread for application processor C, which
+   has not started yet, and returns it, or a null pointer if no
+   page is available.  C runs its startup code on the new
+   thread's stack and then calls thread_start_ap(). */
+struct thread *
+thread_create_idle (struct cpu *c) 
+{
+  struct thread *t;
+  char name[16];
+
+  t = thread_page_get ();
+  if (t == NULL)
+    return NULL;
+
+  snprintf (name, sizeof name, "idle%d", c->id);
+  init_thread (t, name, PRI_MIN);
+  t->tid = allocate_tid ();
+
+  spinlock_acquire (&sched_lock);
+  t->priority = t->base_priority = PRI_MIN;
+  t->status = THREAD_RUNNING;
+  t->cpu = c;
+  c->idle_thread = c->running = t;
+  spinlock_release (&sched_lock);
+
+  return t;
+}
+
+/* Called by an application processor, on the stack of the
+   thread that thread_create_idle() created for it, to start
+   scheduling threads.  Interrupts must be off. */
+void
+thread_start_ap (void) 
+{
+  struct cpu *c = cpu_current ();
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (running_thread () == c->idle_thread);
+
+  c->switch_ns = clock_ns ();
+  intr_enable ();
+  idle_loop ();
+}
+
+/* Called by the timer interrupt handler at each timer tick, on
+   each CPU.  Thus, this function runs in an external interrupt
+   context. */
 void
 thread_tick (void) 
 {
+  struct cpu *c = cpu_current ();
   struct thread *t = thread_current ();
 
+  spinlock_acquire (&sched_lock);
+
   /* Update statistics. */
-  if (t == idle_thread)
-    idle_ticks++;
+  if (t == c->idle_thread)
+    c->idle_ticks++;
 #ifdef USERPROG
   else if (t->pagedir != NULL)
-    user_ticks++;
+    c->user_ticks++;
 #endif
   else
-    kernel_ticks++;
+    c->kernel_ticks++;
+
+  if (thread_mlfqs)
+    mlfqs_tick (c, t);
 
   /* Enforce preemption. */
-  if (++thread_ticks >= TIME_SLICE)
-    intr_yield_on_return ();
+  if (++c->thread_ticks >= TIME_SLICE) 
+    {
+      c->preempting = true;
+      intr_yield_on_return ();
+    }
+
+  spinlock_release (&sched_lock);
 }
 
-/* Prints thread statistics. */
+/* Prints thread statistics, totaled over all the CPUs and, if
+   more than one ran, for each CPU. */
 void
 thread_print_stats (void) 
 {
+  long long idle_ticks = 0, kernel_ticks = 0, user_ticks = 0;
+  uint64_t idle_ns = 0, kernel_ns = 0, user_ns = 0;
+  long long steal_cnt = 0, migrate_cnt = 0;
+  int i;
+
+  for (i = 0; i < cpu_cnt; i++) 
+    {
+      struct cpu *c = &cpus[i];
+      idle_ticks += c->idle_ticks;
+      kernel_ticks += c->kernel_ticks;
+      user_ticks += c->user_ticks;
+      idle_ns += c->idle_ns;
+      kernel_ns += c->kernel_ns;
+      user_ns += c->user_ns;
+      steal_cnt += c->steal_cnt;
+      migrate_cnt += c->migrate_cnt;
+    }
+
   printf ("Thread: %lld idle ticks, %lld kernel ticks, %lld user ticks\n",
           idle_ticks, kernel_ticks, user_ticks);
+  printf ("Thread: %"PRIu64" ns idle, %"PRIu64" ns kernel, %"PRIu64" ns user\n",
+          idle_ns, kernel_ns, user_ns);
+  printf ("Thread: %lld steals, %lld migrations\n", steal_cnt, migrate_cnt);
+  if (cpu_cnt > 1)
+    for (i = 0; i < cpu_cnt; i++) 
+      {
+        struct cpu *c = &cpus[i];
+        printf ("Thread: CPU %d: %lld idle ticks, %lld kernel ticks, "
+                "%lld user ticks, %lld steals, %lld migrations\n",
+                i, c->idle_ticks, c->kernel_ticks, c->user_ticks,
+                c->steal_cnt, c->migrate_cnt);
+      }
+  if (thread_schedstat)
+    schedstat_print ();
 }
 
 /* Creates a new kernel thread named NAME with the given initial
@@ -157,11 +320,9 @@ thread_print_stats (void)
    before thread_create() returns.  Contrariwise, the original
    thread may run for any amount of time before the new thread is
    scheduled.  Use a semaphore or some other form of
-   synchronization if you need to ensure ordering.
-
-   The code provided sets the new thread's `priority' member to
-   PRIORITY, but no actual priority scheduling is implemented.
-   Priority scheduling is the goal of Problem 1-3. */
+   synchronization if you need to ensure ordering.  In
+   particular, if PRIORITY is higher than the running thread's
+   priority, the new thread runs immediately. */
 tid_t
 thread_create (const char *name, int priority,
                thread_func *function, void *aux) 
@@ -171,12 +332,11 @@ thread_create (const char *name, int priority,
   struct switch_entry_frame *ef;
   struct switch_threads_frame *sf;
   tid_t tid;
-  enum intr_level old_level;
 
   ASSERT (function != NULL);
 
   /* Allocate thread. */
-  t = palloc_get_page (PAL_ZERO);
+  t = thread_page_get ();
   if (t == NULL)
     return TID_ERROR;
 
@@ -187,7 +347,7 @@ thread_create (const char *name, int priority,
   /* Prepare thread for first run by initializing its stack.
      Do this atomically so intermediate values for the 'stack' 
      member cannot be observed. */
-  old_level = intr_disable ();
+  spinlock_acquire (&sched_lock);
 
   /* Stack frame for kernel_thread(). */
   kf = alloc_frame (t, sizeof *kf);
@@ -204,7 +364,11 @@ thread_create (const char *name, int priority,
   sf->eip = switch_entry;
   sf->ebp = 0;
 
-  intr_set_level (old_level);
+  /* The thread starts out holding sched_lock, which
+     kernel_thread() releases, turning interrupts on. */
+  t->sched_depth = 1;
+  t->sched_level = INTR_ON;
+  spinlock_release (&sched_lock);
 
   /* Add to run queue. */
   thread_unblock (t);
@@ -215,14 +379,14 @@ thread_create (const char *name, int priority,
 /* Puts the current thread to sleep.  It will not be scheduled
    again until awoken by thread_unblock().
 
-   This function must be called with interrupts turned off.  It
-   is usually a better idea to use one of the synchronization
+   This function must be called with sched_lock held.  It is
+   usually a better idea to use one of the synchronization
    primitives in synch.h. */
 void
 thread_block (void) 
 {
   ASSERT (!intr_context ());
-  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (spinlock_held_by_current_cpu (&sched_lock));
 
   thread_current ()->status = THREAD_BLOCKED;
   schedule ();
@@ -232,22 +396,35 @@ thread_block (void)
    This is an error if T is not blocked.  (Use thread_yield() to
    make the running thread ready.)
 
-   This function does not preempt the running thread.  This can
-   be important: if the caller had disabled interrupts itself,
-   it may expect that it can atomically unblock a thread and
-   update other data. */
+   T joins the run queue of the CPU that select_cpu() chooses.
+   If that is another CPU and T should preempt the thread running
+   there, that CPU is interrupted to make it reschedule.
+
+   If T has a higher priority than the running thread, the
+   running thread is preempted, but only if interrupts were on
+   at entry (or, within an interrupt handler, when the handler
+   returns).  This can be important: if the caller had disabled
+   interrupts itself, it may expect that it can atomically
+   unblock a thread and update other data.  Such a caller should
+   call thread_preempt() after re-enabling interrupts. */
 void
 thread_unblock (struct thread *t) 
 {
-  enum intr_level old_level;
+  struct cpu *c;
 
   ASSERT (is_thread (t));
 
-  old_level = intr_disable ();
+  spinlock_acquire (&sched_lock);
   ASSERT (t->status == THREAD_BLOCKED);
-  list_push_back (&ready_list, &t->elem);
+  if (thread_schedstat)
+    t->ready_ns = clock_ns ();
+  c = select_cpu (t);
+  ready_push (c, t);
   t->status = THREAD_READY;
-  intr_set_level (old_level);
+  cpu_kick (c, t);
+  spinlock_release (&sched_lock);
+
+  thread_preempt ();
 }
 
 /* Returns the name of the running thread. */
@@ -297,7 +474,7 @@ thread_exit (void)
   /* Remove thread from all threads list, set our status to dying,
      and schedule another process.  That process will destroy us
      when it calls thread_schedule_tail(). */
-  intr_disable ();
+  spinlock_acquire (&sched_lock);
   list_remove (&thread_current()->allelem);
   thread_current ()->status = THREAD_DYING;
   schedule ();
@@ -310,26 +487,54 @@ void
 thread_yield (void) 
 {
   struct thread *cur = thread_current ();
-  enum intr_level old_level;
   
   ASSERT (!intr_context ());
 
-  old_level = intr_disable ();
-  if (cur != idle_thread) 
-    list_push_back (&ready_list, &cur->elem);
+  spinlock_acquire (&sched_lock);
+  if (thread_schedstat)
+    cur->ready_ns = clock_ns ();
+  if (!is_idle (cur)) 
+    ready_push (cur->cpu, cur);
   cur->status = THREAD_READY;
   schedule ();
-  intr_set_level (old_level);
+  spinlock_release (&sched_lock);
+}
+
+/* Yields the CPU if a ready thread has a higher priority than
+   the running thread.  Within an external interrupt handler, the
+   yield happens when the handler returns.  Outside an interrupt
+   handler, does nothing if interrupts are off, because the
+   caller may be relying on atomicity; such a caller should call
+   this function again after turning interrupts back on. */
+void
+thread_preempt (void) 
+{
+  struct cpu *c;
+
+  if (!intr_context () && intr_get_level () == INTR_OFF)
+    return;
+
+  spinlock_acquire (&sched_lock);
+  c = cpu_current ();
+  if (ready_max_priority (c) > thread_current ()->priority)
+    {
+      c->preempting = true;
+      if (intr_context ())
+        intr_yield_on_return ();
+      else
+        thread_yield ();
+    }
+  spinlock_release (&sched_lock);
 }
 
 /* Invoke function 'func' on all threads, passing along 'aux'.
-   This function must be called with interrupts off. */
+   This function must be called with sched_lock held. */
 void
 thread_foreach (thread_action_func *func, void *aux)
 {
   struct list_elem *e;
 
-  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (spinlock_held_by_current_cpu (&sched_lock));
 
   for (e = list_begin (&all_list); e != list_end (&all_list);
        e = list_next (e))
@@ -339,11 +544,79 @@ thread_foreach (thread_action_func *func, void *aux)
     }
 }
 
-/* Sets the current thread's priority to NEW_PRIORITY. */
+/* Sets the current thread's base priority to NEW_PRIORITY.  The
+   thread keeps any higher priority donated to it until the
+   donation is withdrawn.  Yields the CPU if the running thread no
+   longer has the highest priority.
+
+   Has no effect under the MLFQS, which computes priorities
+   itself. */
 void
 thread_set_priority (int new_priority) 
 {
-  thread_current ()->priority = new_priority;
+  struct thread *cur = thread_current ();
+
+  ASSERT (PRI_MIN <= new_priority && new_priority <= PRI_MAX);
+
+  if (thread_mlfqs)
+    return;
+
+  spinlock_acquire (&sched_lock);
+  cur->base_priority = new_priority;
+  thread_update_priority (cur);
+  spinlock_release (&sched_lock);
+
+  thread_preempt ();
+}
+
+/* Raises T's priority to PRIORITY, if it is lower, on behalf of
+   a thread waiting for a lock that T holds.  The caller must
+   hold sched_lock.  The donation lasts until T's priority is
+   next recomputed by thread_update_priority(). */
+void
+thread_donate_priority (struct thread *t, int priority) 
+{
+  ASSERT (is_thread (t));
+  ASSERT (spinlock_held_by_current_cpu (&sched_lock));
+
+  if (t->priority < priority)
+    change_priority (t, priority);
+}
+
+/* Recomputes T's priority as the higher of its base priority and
+   the highest priority of any thread waiting for a lock that T
+   holds.  The caller must hold sched_lock.  Does nothing under
+   the MLFQS, which does not use priority donation. */
+void
+thread_update_priority (struct thread *t) 
+{
+  int priority = t->base_priority;
+  struct list_elem *e;
+
+  ASSERT (is_thread (t));
+  ASSERT (spinlock_held_by_current_cpu (&sched_lock));
+
+  if (thread_mlfqs)
+    return;
+
+  for (e = list_begin (&t->held_locks); e != list_end (&t->held_locks);
+       e = list_next (e))
+    {
+      struct lock *lock = list_entry (e, struct lock, elem);
+      struct list *waiters = &lock->semaphore.waiters;
+      struct list_elem *w;
+
+      for (w = list_begin (waiters); w != list_end (waiters);
+           w = list_next (w))
+        {
+          struct thread *waiter = list_entry (w, struct thread, elem);
+          if (waiter->priority > priority)
+            priority = waiter->priority;
+        }
+    }
+
+  if (t->priority != priority)
+    change_priority (t, priority);
 }
 
 /* Returns the current thread's priority. */
@@ -353,72 +626,211 @@ thread_get_priority (void)
   return thread_current ()->priority;
 }
 
-/* Sets the current thread's nice value to NICE. */
+/* Sets the current thread's nice value to NICE and recomputes
+   its priority, yielding the CPU if it no longer has the highest
+   priority. */
 void
-thread_set_nice (int nice UNUSED) 
+thread_set_nice (int nice) 
 {
-  /* Not yet implemented. */
+  struct thread *cur = thread_current ();
+
+  ASSERT (NICE_MIN <= nice && nice <= NICE_MAX);
+
+  spinlock_acquire (&sched_lock);
+  cur->nice = nice;
+  if (thread_mlfqs)
+    mlfqs_update_priority (cur);
+  spinlock_release (&sched_lock);
+
+  thread_preempt ();
 }
 
 /* Returns the current thread's nice value. */
 int
 thread_get_nice (void) 
 {
-  /* Not yet implemented. */
-  return 0;
+  return thread_current ()->nice;
 }
 
 /* Returns 100 times the system load average. */
 int
 thread_get_load_avg (void) 
 {
-  /* Not yet implemented. */
-  return 0;
+  int load_avg_100;
+
+  spinlock_acquire (&sched_lock);
+  load_avg_100 = fp_round (load_avg * 100);
+  spinlock_release (&sched_lock);
+  return load_avg_100;
 }
 
 /* Returns 100 times the current thread's recent_cpu value. */
 int
 thread_get_recent_cpu (void) 
 {
-  /* Not yet implemented. */
-  return 0;
+  int recent_cpu_100;
+
+  spinlock_acquire (&sched_lock);
+  recent_cpu_100 = fp_round (thread_current ()->recent_cpu * 100);
+  spinlock_release (&sched_lock);
+  return recent_cpu_100;
+}
+
+/* Does the MLFQS bookkeeping for timer tick on CPU C, with T as
+   the running thread.
+
+   Only the running threads' recent_cpu values change from one
+   tick to the next, so the priority update every
+   MLFQS_PRIORITY_TICKS ticks need only recompute T's priority.
+   Once per second, every thread's recent_cpu decays, so every
+   priority is recomputed then, by the BSP alone; the decay
+   coefficient is the same for all threads and is computed only
+   once.  This keeps the common tick O(1) and the once-per-second
+   tick a single pass over all_list, whatever the number of
+   threads. */
+static void
+mlfqs_tick (struct cpu *c, struct thread *t) 
+{
+  int64_t ticks = timer_ticks ();
+
+  ASSERT (intr_context ());
+  ASSERT (spinlock_held_by_current_cpu (&sched_lock));
+
+  if (t != c->idle_thread)
+    t->recent_cpu = fp_add_int (t->recent_cpu, 1);
+
+  if (ticks % TIMER_FREQ == 0 && c->id == 0)
+    {
+      int ready_threads = 0;
+      fixed_point coef;
+      int i;
+
+      for (i = 0; i < cpu_cnt; i++)
+        ready_threads += cpu_load (&cpus[i]);
+
+      /* load_avg = (59/60) * load_avg + (1/60) * ready_threads. */
+      load_avg = (load_avg * 59 + fp_from_int (ready_threads)) / 60;
+
+      /* coef = (2 * load_avg) / (2 * load_avg + 1). */
+      coef = fp_div (load_avg * 2, fp_add_int (load_avg * 2, 1));
+      thread_foreach (mlfqs_update_recent_cpu, &coef);
+    }
+  else if (ticks % MLFQS_PRIORITY_TICKS == 0)
+    mlfqs_update_priority (t);
+
+  if (ready_max_priority (c) > t->priority) 
+    {
+      c->preempting = true;
+      intr_yield_on_return ();
+    }
+}
+
+/* Decays T's recent_cpu by the coefficient that COEF_ points
+   to, then recomputes T's priority.  The caller must hold
+   sched_lock. */
+static void
+mlfqs_update_recent_cpu (struct thread *t, void *coef_) 
+{
+  const fixed_point *coef = coef_;
+
+  if (is_idle (t))
+    return;
+  t->recent_cpu = fp_add_int (fp_mul (*coef, t->recent_cpu), t->nice);
+  mlfqs_update_priority (t);
+}
+
+/* Recomputes T's priority with mlfqs_priority().  The caller
+   must hold sched_lock. */
+static void
+mlfqs_update_priority (struct thread *t) 
+{
+  int priority;
+
+  ASSERT (spinlock_held_by_current_cpu (&sched_lock));
+
+  if (is_idle (t))
+    return;
+
+  priority = t->base_priority = mlfqs_priority (t);
+  if (t->priority != priority)
+    change_priority (t, priority);
+}
+
+/* Returns the MLFQS priority for T, computed from its recent_cpu
+   and nice values as PRI_MAX - (recent_cpu / 4) - (nice * 2) and
+   clamped to the valid range. */
+static int
+mlfqs_priority (const struct thread *t) 
+{
+  int priority = PRI_MAX - fp_trunc (t->recent_cpu / 4) - t->nice * 2;
+
+  if (priority < PRI_MIN)
+    return PRI_MIN;
+  else if (priority > PRI_MAX)
+    return PRI_MAX;
+  else
+    return priority;
 }
 
-/* Idle thread.  Executes when no other thread is ready to run.
+/* The BSP's idle thread.  Executes when no other thread is
+   ready to run on the BSP.  (The APs' idle threads are created
+   by thread_create_idle() instead.)
 
    The idle thread is initially put on the ready list by
    thread_start().  It will be scheduled once initially, at which
-   point it initializes idle_thread, "up"s the semaphore passed
-   to it to enable thread_start() to continue, and immediately
-   blocks.  After that, the idle thread never appears in the
-   ready list.  It is returned by next_thread_to_run() as a
-   special case when the ready list is empty. */
+   point it initializes the BSP's idle_thread, "up"s the
+   semaphore passed to it to enable thread_start() to continue,
+   and immediately blocks.  After that, the idle thread never
+   appears in the ready list.  It is returned by
+   next_thread_to_run() as a special case when the ready list is
+   empty. */
 static void
 idle (void *idle_started_ UNUSED) 
 {
   struct semaphore *idle_started = idle_started_;
-  idle_thread = thread_current ();
+  struct thread *t = thread_current ();
+
+  /* Under the MLFQS, init_thread() gave us a computed priority
+     like any other thread.  The idle thread must stay lowest. */
+  spinlock_acquire (&sched_lock);
+  t->cpu->idle_thread = t;
+  t->priority = t->base_priority = PRI_MIN;
+  spinlock_release (&sched_lock);
   sema_up (idle_started);
 
+  idle_loop ();
+}
+
+/* Body of each CPU's idle thread. */
+static void
+idle_loop (void) 
+{
+  struct cpu *c = cpu_current ();
+
   for (;;) 
     {
       /* Let someone else run. */
-      intr_disable ();
+      spinlock_acquire (&sched_lock);
       thread_block ();
+      spinlock_release (&sched_lock);
+
+      /* Zero pages for palloc() while there is nothing else to
+         do.  Interrupts are on meanwhile, so that a thread that
+         becomes ready can preempt us.  If one did not, because it
+         has priority PRI_MIN too, let it run. */
+      intr_enable ();
+      while (c->ready_cnt == 0 && palloc_zero_idle ())
+        continue;
+      intr_disable ();
+      if (c->ready_cnt > 0)
+        continue;
 
-      /* Re-enable interrupts and wait for the next one.
-
-         The `sti' instruction disables interrupts until the
-         completion of the next instruction, so these two
-         instructions are executed atomically.  This atomicity is
-         important; otherwise, an interrupt could be handled
-         between re-enabling interrupts and waiting for the next
-         one to occur, wasting as much as one clock tick worth of
-         time.
+      /* If tickless idle is enabled, stop the periodic timer
+         interrupt until something is due. */
+      timer_idle_enter ();
 
-         See [IA32-v2a] "HLT", [IA32-v2b] "STI", and [IA32-v3a]
-         7.11.1 "HLT Instruction". */
-      asm volatile ("sti; hlt" : : : "memory");
+      /* Re-enable interrupts and wait for the next one. */
+      intr_halt ();
     }
 }
 
@@ -428,7 +840,7 @@ kernel_thread (thread_func *function, void *aux)
 {
   ASSERT (function != NULL);
 
-  intr_enable ();       /* The scheduler runs with interrupts off. */
+  spinlock_release (&sched_lock); /* The scheduler runs with it held. */
   function (aux);       /* Execute the thread function. */
   thread_exit ();       /* If function() returns, kill the thread. */
 }
@@ -454,6 +866,13 @@ is_thread (struct thread *t)
   return t != NULL && t->magic == THREAD_MAGIC;
 }
 
+/* Returns true if T is a CPU's idle thread. */
+static bool
+is_idle (const struct thread *t) 
+{
+  return t->cpu != NULL && t == t->cpu->idle_thread;
+}
+
 /* Does basic initialization of T as a blocked thread named
    NAME. */
 static void
@@ -467,9 +886,95 @@ init_thread (struct thread *t, const char *name, int priority)
   t->status = THREAD_BLOCKED;
   strlcpy (t->name, name, sizeof t->name);
   t->stack = (uint8_t *) t + PGSIZE;
-  t->priority = priority;
+  t->priority = t->base_priority = priority;
+  list_init (&t->held_locks);
   t->magic = THREAD_MAGIC;
+
+  /* Under the MLFQS, a new thread inherits its parent's nice and
+     recent_cpu values and ignores the requested priority.  The
+     initial thread starts with both values 0. */
+  if (thread_mlfqs)
+    {
+      struct thread *parent = running_thread ();
+      if (parent != t)
+        {
+          t->nice = parent->nice;
+          t->recent_cpu = parent->recent_cpu;
+        }
+      t->priority = t->base_priority = mlfqs_priority (t);
+    }
+
+  /* The timer interrupt walks all_list under the MLFQS. */
+  spinlock_acquire (&sched_lock);
   list_push_back (&all_list, &t->allelem);
+  spinlock_release (&sched_lock);
+}
+
+/* Obtains a page for a new thread, preferring one from the
+   cache of pages freed by exited threads.  The
+   page is not zeroed: init_thread() clears struct thread and
+   resets its magic number, and the rest of the page is stack,
+   which needs no particular contents.  Returns a null pointer
+   if no page is available. */
+static struct thread *
+thread_page_get (void) 
+{
+  struct thread *t = NULL;
+
+  spinlock_acquire (&sched_lock);
+  if (!list_empty (&thread_cache)) 
+    {
+      t = list_entry (list_pop_front (&thread_cache), struct thread, elem);
+      thread_cache_cnt--;
+    }
+  spinlock_release (&sched_lock);
+
+  return t != NULL ? t : palloc_get_page (0);
+}
+
+/* Releases the page of dead thread T, keeping it in the cache
+   if there is room.  The caller must hold sched_lock and, for
+   palloc_free_page(), the interrupt lock as well. */
+static void
+thread_page_free (struct thread *t) 
+{
+  ASSERT (spinlock_held_by_current_cpu (&sched_lock));
+
+  if (thread_cache_cnt < thread_cache_max) 
+    {
+      list_push_front (&thread_cache, &t->elem);
+      thread_cache_cnt++;
+    }
+  else
+    palloc_free_page (t);
+}
+
+/* Frees all the pages in the thread cache.  Returns true if
+   there were any.  Called by the page allocator when it runs out
+   of memory. */
+static bool
+thread_cache_reclaim (void) 
+{
+  struct list pages;
+  bool freed = false;
+
+  /* palloc_free_page() takes the interrupt lock, which must not
+     be waited for while holding sched_lock, so take the pages
+     out of the cache first. */
+  list_init (&pages);
+  spinlock_acquire (&sched_lock);
+  while (!list_empty (&thread_cache))
+    list_push_back (&pages, list_pop_front (&thread_cache));
+  thread_cache_cnt = 0;
+  spinlock_release (&sched_lock);
+
+  while (!list_empty (&pages)) 
+    {
+      palloc_free_page (list_entry (list_pop_front (&pages),
+                                    struct thread, elem));
+      freed = true;
+    }
+  return freed;
 }
 
 /* Allocates a SIZE-byte frame at the top of thread T's stack and
@@ -485,29 +990,246 @@ alloc_frame (struct thread *t, size_t size)
   return t->stack;
 }
 
-/* Chooses and returns the next thread to be scheduled.  Should
-   return a thread from the run queue, unless the run queue is
+/* Adds T to the back of CPU C's run queue for its priority.
+   The caller must hold sched_lock. */
+static void
+ready_push (struct cpu *c, struct thread *t) 
+{
+  ASSERT (spinlock_held_by_current_cpu (&sched_lock));
+  ASSERT (PRI_MIN <= t->priority && t->priority <= PRI_MAX);
+
+  t->cpu = c;
+  list_push_back (&c->ready_lists[t->priority], &t->elem);
+  c->ready_map[t->priority / 32] |= 1u << (t->priority % 32);
+  c->ready_cnt++;
+}
+
+/* Removes T from the run queue it is in.  The caller must hold
+   sched_lock. */
+static void
+ready_remove (struct thread *t) 
+{
+  struct cpu *c = t->cpu;
+
+  ASSERT (spinlock_held_by_current_cpu (&sched_lock));
+  ASSERT (t->status == THREAD_READY);
+
+  list_remove (&t->elem);
+  if (list_empty (&c->ready_lists[t->priority]))
+    c->ready_map[t->priority / 32] &= ~(1u << (t->priority % 32));
+  c->ready_cnt--;
+}
+
+/* Sets T's priority to PRIORITY, moving T to the matching ready
+   list if it is in a run queue.  The caller must hold
+   sched_lock. */
+static void
+change_priority (struct thread *t, int priority) 
+{
+  ASSERT (PRI_MIN <= priority && priority <= PRI_MAX);
+
+  if (t->status == THREAD_READY && !is_idle (t))
+    {
+      bool raised = priority > t->priority;
+      ready_remove (t);
+      t->priority = priority;
+      ready_push (t->cpu, t);
+      if (raised)
+        cpu_kick (t->cpu, t);
+    }
+  else
+    t->priority = priority;
+}
+
+/* Returns the highest priority of any thread in CPU C's run
+   queue, or PRI_MIN - 1 if the run queue is empty.  The caller
+   must hold sched_lock. */
+static int
+ready_max_priority (const struct cpu *c) 
+{
+  int i;
+
+  ASSERT (spinlock_held_by_current_cpu (&sched_lock));
+
+  for (i = sizeof c->ready_map / sizeof *c->ready_map - 1; i >= 0; i--)
+    if (c->ready_map[i] != 0)
+      return i * 32 + (31 - __builtin_clz (c->ready_map[i]));
+  return PRI_MIN - 1;
+}
+
+/* Chooses and returns the next thread for CPU C to run.  Should
+   return a thread from C's run queue, unless the run queue is
    empty.  (If the running thread can continue running, then it
-   will be in the run queue.)  If the run queue is empty, return
-   idle_thread. */
+   will be in the run queue.)  If the run queue is empty, try to
+   steal a thread from another CPU, and failing that return C's
+   idle thread.
+
+   The thread chosen is the one that has been waiting longest
+   among those with the highest priority. */
 static struct thread *
-next_thread_to_run (void) 
+next_thread_to_run (struct cpu *c) 
 {
-  if (list_empty (&ready_list))
-    return idle_thread;
-  else
-    return list_entry (list_pop_front (&ready_list), struct thread, elem);
+  int priority = ready_max_priority (c);
+  struct list *list;
+  struct thread *t;
+
+  if (priority < PRI_MIN) 
+    {
+      t = steal_thread (c);
+      return t != NULL ? t : c->idle_thread;
+    }
+
+  list = &c->ready_lists[priority];
+  t = list_entry (list_pop_front (list), struct thread, elem);
+  if (list_empty (list))
+    c->ready_map[priority / 32] &= ~(1u << (priority % 32));
+  c->ready_cnt--;
+  return t;
+}
+
+/* Takes a ready thread away from the CPU with the longest run
+   queue, for CPU C, whose own run queue is empty, to run.
+   Prefers the highest-priority thread that is not cache-hot,
+   taking it from the back of its list, the end opposite to the
+   one its own CPU takes threads from.  Returns the stolen
+   thread, or a null pointer if there is nothing worth stealing.
+
+   An idle CPU comes here each time its idle thread runs, which
+   is at least once per timer tick.  The caller must hold
+   sched_lock. */
+static struct thread *
+steal_thread (struct cpu *c) 
+{
+  struct cpu *victim = NULL;
+  int priority;
+  int i;
+
+  ASSERT (spinlock_held_by_current_cpu (&sched_lock));
+
+  for (i = 0; i < cpu_cnt; i++)
+    if (&cpus[i] != c && cpus[i].ready_cnt > 0
+        && (victim == NULL || cpus[i].ready_cnt > victim->ready_cnt))
+      victim = &cpus[i];
+  if (victim == NULL)
+    return NULL;
+
+  for (priority = ready_max_priority (victim); priority >= PRI_MIN;
+       priority--)
+    {
+      struct list *list = &victim->ready_lists[priority];
+      struct list_elem *e;
+
+      for (e = list_rbegin (list); e != list_rend (list); e = list_prev (e))
+        {
+          struct thread *t = list_entry (e, struct thread, elem);
+          if (!is_cache_hot (t)) 
+            {
+              ready_remove (t);
+              t->cpu = c;
+              c->steal_cnt++;
+              c->migrate_cnt++;
+              return t;
+            }
+        }
+    }
+  return NULL;
+}
+
+/* Returns the CPU whose run queue T, which is about to become
+   ready, should join.  That is the CPU that T last ran on, if it
+   has nothing else to do or if T is cache-hot, so that T finds
+   its data still in that CPU's caches.  Otherwise, it is the CPU
+   with the least work, as counted by cpu_load(), preferring T's
+   last CPU, or for a new thread the current CPU, in case of a
+   tie.  The caller must hold sched_lock. */
+static struct cpu *
+select_cpu (const struct thread *t) 
+{
+  struct cpu *best = t->cpu != NULL ? t->cpu : cpu_current ();
+  int i;
+
+  if (cpu_load (best) == 0 || (t->cpu != NULL && is_cache_hot (t)))
+    return best;
+  for (i = 0; i < cpu_cnt; i++)
+    if (cpu_load (&cpus[i]) < cpu_load (best))
+      best = &cpus[i];
+  if (t->cpu != NULL && best != t->cpu)
+    cpu_current ()->migrate_cnt++;
+  return best;
+}
+
+/* Returns true if T was switched out so recently that moving it
+   to another CPU would likely cost more in cache misses than it
+   gains. */
+static bool
+is_cache_hot (const struct thread *t) 
+{
+  return timer_ticks () - t->last_run < CACHE_HOT_TICKS;
+}
+
+/* Returns the number of threads that CPU C is running or has
+   ready to run, not counting its idle thread. */
+static int
+cpu_load (const struct cpu *c) 
+{
+  return c->ready_cnt + (c->running != c->idle_thread);
+}
+
+/* Interrupts CPU C, if it is not the current CPU, to make it
+   reschedule, if T, which is in C's run queue, should preempt
+   the thread it is running.  The caller must hold sched_lock. */
+static void
+cpu_kick (struct cpu *c, const struct thread *t) 
+{
+  if (c != cpu_current ()
+      && (c->running == c->idle_thread
+          || t->priority > c->running->priority))
+    cpu_send_reschedule (c);
+}
+
+/* Acquires the interrupt lock, if this CPU does not already
+   hold it, on behalf of the thread that this CPU just switched
+   to, which holds sched_lock.  The interrupt lock must be taken
+   first, so if another CPU holds it, sched_lock is released
+   while waiting for it.  The switch is complete by then, so
+   other CPUs may take the thread switched away from. */
+static void
+take_intr_lock (void) 
+{
+  unsigned depth;
+  enum intr_level level;
+
+  if (intr_lock_try_acquire ())
+    return;
+
+  depth = sched_lock.depth;
+  level = sched_lock.old_level;
+  sched_lock.depth = 1;
+  sched_lock.old_level = INTR_OFF;
+  spinlock_release (&sched_lock);
+
+  intr_disable ();
+
+  spinlock_acquire (&sched_lock);
+  sched_lock.depth = depth;
+  sched_lock.old_level = level;
 }
 
 /* Completes a thread switch by activating the new thread's page
    tables, and, if the previous thread is dying, destroying it.
 
    At this function's invocation, we just switched from thread
-   PREV, the new thread is already running, and interrupts are
-   still disabled.  This function is normally invoked by
-   thread_schedule() as its final action before returning, but
-   the first time a thread is scheduled it is called by
-   switch_entry() (see switch.S).
+   PREV, the new thread is already running, interrupts are still
+   disabled, and this CPU holds sched_lock, which the new thread
+   takes over as it last left it.  This function is normally
+   invoked by thread_schedule() as its final action before
+   returning, but the first time a thread is scheduled it is
+   called by switch_entry() (see switch.S).
+
+   schedule() released the interrupt lock, if this CPU held it,
+   before switching.  A thread that was switched out with
+   interrupts off, aside from sched_lock, held the interrupt lock
+   then, so it gets the interrupt lock back here.
 
    It's not safe to call printf() until the thread switch is
    complete.  In practice that means that printf()s should be
@@ -519,34 +1241,51 @@ void
 thread_schedule_tail (struct thread *prev)
 {
   struct thread *cur = running_thread ();
+  struct cpu *c = cur->cpu;
   
   ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (sched_lock.cpu == c);
 
   /* Mark us as running. */
   cur->status = THREAD_RUNNING;
+  c->running = cur;
 
   /* Start new time slice. */
-  thread_ticks = 0;
+  if (thread_schedstat)
+    schedstat_switch_in (cur);
+  c->thread_ticks = 0;
 
 #ifdef USERPROG
   /* Activate the new address space. */
   process_activate ();
 #endif
 
-  /* If the thread we switched from is dying, destroy its struct
-     thread.  This must happen late so that thread_exit() doesn't
-     pull out the rug under itself.  (We don't free
-     initial_thread because its memory was not obtained via
-     palloc().) */
-  if (prev != NULL && prev->status == THREAD_DYING && prev != initial_thread) 
+  if (prev != NULL) 
     {
-      ASSERT (prev != cur);
-      palloc_free_page (prev);
+      /* If the thread we switched from is dying, destroy its
+         struct thread.  This must happen late so that
+         thread_exit() doesn't pull out the rug under itself.
+         (We don't free initial_thread because its memory was not
+         obtained via palloc().)  Freeing the page may take the
+         interrupt lock. */
+      bool dying = prev->status == THREAD_DYING && prev != initial_thread;
+
+      sched_lock.depth = cur->sched_depth;
+      sched_lock.old_level = cur->sched_level;
+      if (dying || cur->sched_level == INTR_OFF)
+        take_intr_lock ();
+      if (dying) 
+        {
+          ASSERT (prev != cur);
+          thread_page_free (prev);
+        }
+      if (cur->sched_level == INTR_ON)
+        intr_lock_release ();
     }
 }
 
-/* Schedules a new process.  At entry, interrupts must be off and
-   the running process's state must have been changed from
+/* Schedules a new process.  At entry, sched_lock must be held
+   and the running process's state must have been changed from
    running to some other state.  This function finds another
    thread to run and switches to it.
 
@@ -556,18 +1295,138 @@ static void
 schedule (void) 
 {
   struct thread *cur = running_thread ();
-  struct thread *next = next_thread_to_run ();
+  struct cpu *c = cur->cpu;
+  struct thread *next;
   struct thread *prev = NULL;
+  uint64_t ran_ns;
 
-  ASSERT (intr_get_level () == INTR_OFF);
+  ASSERT (spinlock_held_by_current_cpu (&sched_lock));
   ASSERT (cur->status != THREAD_RUNNING);
+
+  /* Account for ticks that passed without timer interrupts while
+     we were idle. */
+  if (cur == c->idle_thread)
+    c->idle_ticks += timer_idle_exit ();
+  ran_ns = account_run_time (c, cur);
+  cur->last_run = timer_ticks ();
+  if (thread_schedstat)
+    schedstat_switch_out (c, cur, ran_ns);
+  c->preempting = false;
+
+  next = next_thread_to_run (c);
   ASSERT (is_thread (next));
 
   if (cur != next)
-    prev = switch_threads (cur, next);
+    {
+      /* Save our hold on sched_lock, for thread_schedule_tail()
+         to restore when we run again, and let go of the
+         interrupt lock while we are switched out. */
+      cur->sched_depth = sched_lock.depth;
+      cur->sched_level = sched_lock.old_level;
+      intr_lock_release ();
+      next->cpu = c;
+      prev = switch_threads (cur, next);
+    }
   thread_schedule_tail (prev);
 }
 
+/* Charges the time since the last thread switch on CPU C to T,
+   which is running, and starts a new interval.  Returns the
+   number of nanoseconds charged.  The caller must hold
+   sched_lock. */
+static uint64_t
+account_run_time (struct cpu *c, struct thread *t) 
+{
+  uint64_t now = clock_ns ();
+  uint64_t ran_ns = now - c->switch_ns;
+
+  ASSERT (spinlock_held_by_current_cpu (&sched_lock));
+
+  c->switch_ns = now;
+  t->run_ns += ran_ns;
+  if (t == c->idle_thread)
+    c->idle_ns += ran_ns;
+#ifdef USERPROG
+  else if (t->pagedir != NULL)
+    c->user_ns += ran_ns;
+#endif
+  else
+    c->kernel_ns += ran_ns;
+  return ran_ns;
+}
+
+/* Records statistics for thread T, which ran on CPU C for RAN_NS
+   nanoseconds and is about to stop running.  The switch is
+   involuntary if T is being preempted, and voluntary if T
+   blocked, exited, or called thread_yield() itself.  The caller
+   must hold sched_lock. */
+static void
+schedstat_switch_out (struct cpu *c, struct thread *t, uint64_t ran_ns) 
+{
+  ASSERT (spinlock_held_by_current_cpu (&sched_lock));
+
+  if (t == c->idle_thread)
+    return;
+
+  histogram_add (&slice_hist, ran_ns);
+  histogram_add (&runq_hist, c->ready_cnt);
+  if (c->preempting && t->status == THREAD_READY) 
+    {
+      t->involuntary_switches++;
+      involuntary_switches++;
+    }
+  else
+    {
+      t->voluntary_switches++;
+      voluntary_switches++;
+    }
+}
+
+/* Records statistics for thread T, which has just started
+   running.  The caller must hold sched_lock.  T may have been
+   made ready on another CPU, whose clock may run slightly ahead
+   of this one's, so a negative latency counts as 0. */
+static void
+schedstat_switch_in (struct thread *t) 
+{
+  uint64_t now = clock_ns ();
+  uint64_t latency;
+
+  ASSERT (spinlock_held_by_current_cpu (&sched_lock));
+
+  if (is_idle (t) || t == initial_thread)
+    return;
+
+  latency = now > t->ready_ns ? now - t->ready_ns : 0;
+  histogram_add (&latency_hist, latency);
+  if (latency > t->max_latency_ns)
+    t->max_latency_ns = latency;
+}
+
+/* Prints the scheduler statistics kept when thread_schedstat is
+   true, followed by a line for each thread that still exists. */
+static void
+schedstat_print (void) 
+{
+  struct list_elem *e;
+
+  printf ("Schedstat: %lld voluntary, %lld involuntary context switches\n",
+          voluntary_switches, involuntary_switches);
+  histogram_print (&latency_hist, "Schedstat: wake-up latency (ns)");
+  histogram_print (&slice_hist, "Schedstat: time slice used (ns)");
+  histogram_print (&runq_hist, "Schedstat: run queue length");
+
+  for (e = list_begin (&all_list); e != list_end (&all_list);
+       e = list_next (e)) 
+    {
+      struct thread *t = list_entry (e, struct thread, allelem);
+      printf ("Schedstat: thread %d (%s): %"PRIu64" ns run, %lld voluntary, "
+              "%lld involuntary, max latency %"PRIu64" ns\n",
+              t->tid, t->name, t->run_ns, t->voluntary_switches,
+              t->involuntary_switches, t->max_latency_ns);
+    }
+}
+
 /* Returns a tid to use for a new thread. */
 static tid_t
 allocate_tid (void) 
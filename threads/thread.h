@@ -4,6 +4,12 @@
 #include <debug.h>
 #include <list.h>
 #include <stdint.h>
+#include "threads/fixed-point.h"
+#include "threads/interrupt.h"
+
+struct cpu;
+struct lock;
+struct spinlock;
 
 /* States in a thread's life cycle. */
 enum thread_status
@@ -23,6 +29,12 @@ typedef int tid_t;
 #define PRI_MIN 0                       /* Lowest priority. */
 #define PRI_DEFAULT 31                  /* Default priority. */
 #define PRI_MAX 63                      /* Highest priority. */
+#define PRI_CNT (PRI_MAX - PRI_MIN + 1) /* Number of priorities. */
+
+/* Thread niceness values, for the MLFQS. */
+#define NICE_MIN -20                    /* Most favorable to others. */
+#define NICE_DEFAULT 0                  /* Default niceness. */
+#define NICE_MAX 20                     /* Least favorable to others. */
 
 /* A kernel thread or user process.
 
@@ -76,10 +88,11 @@ typedef int tid_t;
    value, triggering the assertion. */
 /* The `elem' member has a dual purpose.  It can be an element in
    the run queue (thread.c), or it can be an element in a
-   semaphore wait list (synch.c).  It can be used these two ways
-   only because they are mutually exclusive: only a thread in the
-   ready state is on the run queue, whereas only a thread in the
-   blocked state is on a semaphore wait list. */
+   semaphore wait list (synch.c) or the sleep list
+   (devices/timer.c).  It can be used these ways only because
+   they are mutually exclusive: only a thread in the ready state
+   is on the run queue, whereas only a thread in the blocked
+   state is on a semaphore wait list or the sleep list. */
 struct thread
   {
     /* Owned by thread.c. */
@@ -87,12 +100,32 @@ struct thread
     enum thread_status status;          /* Thread state. */
     char name[16];                      /* Name (for debugging purposes). */
     uint8_t *stack;                     /* Saved stack pointer. */
-    int priority;                       /* Priority. */
+    int priority;                       /* Priority, including donations. */
+    int base_priority;                  /* Priority, excluding donations. */
     struct list_elem allelem;           /* List element for all threads list. */
 
+    uint64_t run_ns;                    /* Total nanoseconds spent running. */
+    uint64_t ready_ns;                  /* Time when last made ready. */
+    long long voluntary_switches;       /* # of times blocked or yielded. */
+    long long involuntary_switches;     /* # of times preempted. */
+    uint64_t max_latency_ns;            /* Longest wait from ready to run. */
+    int nice;                           /* Niceness, for the MLFQS. */
+    fixed_point recent_cpu;             /* Recent CPU time, for the MLFQS. */
+    struct cpu *cpu;                    /* CPU running it or last to. */
+    unsigned sched_depth;               /* sched_lock depth while switched out. */
+    enum intr_level sched_level;        /* sched_lock level while switched out. */
+    int64_t last_run;                   /* Tick when last switched out. */
+
     /* Shared between thread.c and synch.c. */
+    struct lock *waiting_lock;          /* Lock being waited for, if any. */
+    struct list held_locks;             /* Locks held by this thread. */
+
+    /* Shared between thread.c, synch.c, and devices/timer.c. */
     struct list_elem elem;              /* List element. */
 
+    /* Owned by devices/timer.c. */
+    int64_t wakeup_tick;                /* Tick to wake up at, if sleeping. */
+
 #ifdef USERPROG
     /* Owned by userprog/process.c. */
     uint32_t *pagedir;                  /* Page directory. */
@@ -102,13 +135,40 @@ struct thread
     unsigned magic;                     /* Detects stack overflow. */
   };
 
+/* Scheduler lock.  Protects the run queues and the state of
+   every thread that the scheduler looks at, and the internals of
+   the synchronization primitives in synch.h, against the other
+   CPUs as well as interrupts.  The lock stays held across a
+   thread switch, and the thread that a CPU switches to releases
+   it, so that no other CPU can pick up the thread switched away
+   from until it is off its stack.  thread_block() requires it;
+   thread_unblock() acquires it itself. */
+extern struct spinlock sched_lock;
+
 /* If false (default), use round-robin scheduler.
    If true, use multi-level feedback queue scheduler.
    Controlled by kernel command-line option "-o mlfqs". */
 extern bool thread_mlfqs;
 
+/* If false (default), keep no scheduler statistics.
+   If true, record scheduling latencies, time slices, and run
+   queue lengths, and print them at shutdown.
+   Controlled by kernel command-line option "-schedstat". */
+extern bool thread_schedstat;
+
+/* Default maximum number of exited threads' pages that
+   thread_create() keeps for reuse. */
+#define THREAD_CACHE_MAX 8
+
+/* Maximum number of exited threads' pages to keep for reuse.
+   0 disables the cache.
+   Controlled by kernel command-line option "-threadcache=N". */
+extern size_t thread_cache_max;
+
 void thread_init (void);
 void thread_start (void);
+struct thread *thread_create_idle (struct cpu *);
+void thread_start_ap (void) NO_RETURN;
 
 void thread_tick (void);
 void thread_print_stats (void);
@@ -125,6 +185,7 @@ const char *thread_name (void);
 
 void thread_exit (void) NO_RETURN;
 void thread_yield (void);
+void thread_preempt (void);
 
 /* Performs some operation on thread t, given auxiliary data AUX. */
 typedef void thread_action_func (struct thread *t, void *aux);
@@ -132,6 +193,8 @@ void thread_foreach (thread_action_func *, void *);
 
 int thread_get_priority (void);
 void thread_set_priority (int);
+void thread_donate_priority (struct thread *, int priority);
+void thread_update_priority (struct thread *);
 
 int thread_get_nice (void);
 void thread_set_nice (int);
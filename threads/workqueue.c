@@ -0,0 +1,293 @@
+#include "threads/workqueue.h"
+#include <debug.h>
+#include <stdio.h>
+#include "threads/interrupt.h"
+#include "threads/thread.h"
+
+/* Work queues.
+
+   Each queue keeps a FIFO list of queued work items and a
+   semaphore that counts them, and a fixed set of worker threads
+   that loop taking items off the list and running them.
+
+   Work can be posted from interrupt handlers (including the
+   timer interrupt handler, which posts delayed work), so the
+   list and the counters in struct workqueue are protected by
+   turning off interrupts, as in devices/intq.c, rather than
+   with a lock. */
+
+/* A thread waiting in workqueue_flush(). */
+struct flusher
+  {
+    struct list_elem elem;      /* Element in workqueue's flushers. */
+    struct semaphore done;      /* Upped when the queue drains. */
+  };
+
+static thread_func worker;
+static timer_event_func delayed_expire;
+static void enqueue (struct workqueue *, struct work *);
+static void wake_flushers (struct workqueue *);
+
+/* Initializes WQ as a work queue named NAME, with WORKER_CNT
+   worker threads running at the given PRIORITY.  At most
+   MAX_LEN work items may be queued or delayed at once.
+   Returns true if successful, false if not all of the worker
+   threads could be created.  Either way, the queue must never
+   be freed, because worker threads never exit.
+
+   NAME should be short, because worker threads are named after
+   it, and it must remain valid as long as WQ does. */
+bool
+workqueue_create (struct workqueue *wq, const char *name,
+                  int worker_cnt, size_t max_len, int priority) 
+{
+  int i;
+
+  ASSERT (wq != NULL);
+  ASSERT (name != NULL);
+  ASSERT (worker_cnt > 0 && worker_cnt <= WORKQUEUE_MAX_WORKERS);
+  ASSERT (max_len > 0);
+
+  wq->name = name;
+  list_init (&wq->queue);
+  sema_init_named (&wq->items, 0, name, -1);
+  wq->len = 0;
+  wq->max_len = max_len;
+  wq->busy = 0;
+  list_init (&wq->flushers);
+
+  for (i = 0; i < worker_cnt; i++) 
+    {
+      char thread_name[16];
+
+      snprintf (thread_name, sizeof thread_name, "%s/%d", name, i);
+      if (thread_create (thread_name, priority, worker, wq) == TID_ERROR)
+        return false;
+    }
+  return true;
+}
+
+/* Waits until WQ has no queued work and none of its workers is
+   running a work item.  Delayed work that has not yet been
+   queued is not waited for.  If work keeps being posted, this
+   may wait indefinitely.
+
+   Must not be called by one of WQ's own work items, which would
+   wait for itself forever. */
+void
+workqueue_flush (struct workqueue *wq) 
+{
+  struct flusher f;
+  enum intr_level old_level;
+
+  ASSERT (!intr_context ());
+
+  sema_init (&f.done, 0);
+  old_level = intr_disable ();
+  if (!list_empty (&wq->queue) || wq->busy > 0) 
+    {
+      list_push_back (&wq->flushers, &f.elem);
+      sema_down (&f.done);
+    }
+  intr_set_level (old_level);
+}
+
+/* Initializes work item W to call FUNC(AUX) when it runs. */
+void
+work_init (struct work *w, work_func *func, void *aux) 
+{
+  ASSERT (w != NULL);
+  ASSERT (func != NULL);
+
+  w->state = WORK_IDLE;
+  w->func = func;
+  w->aux = aux;
+  w->wq = NULL;
+  timer_event_init (&w->timer, delayed_expire, w);
+}
+
+/* Queues W on WQ, to be run by one of WQ's workers.  Returns
+   true if successful, false if W is already queued or delayed
+   or if WQ is full.  May be called from an interrupt handler. */
+bool
+work_post (struct workqueue *wq, struct work *w) 
+{
+  enum intr_level old_level;
+  bool ok;
+
+  ASSERT (wq != NULL);
+  ASSERT (w != NULL);
+
+  old_level = intr_disable ();
+  ok = w->state == WORK_IDLE && wq->len < wq->max_len;
+  if (ok) 
+    {
+      wq->len++;
+      enqueue (wq, w);
+    }
+  intr_set_level (old_level);
+
+  thread_preempt ();
+  return ok;
+}
+
+/* Arranges for W to be queued on WQ after TICKS timer ticks, or
+   right away if TICKS is 0 or less.  Returns true if successful,
+   false if W is already queued or delayed or if WQ is full.  A
+   delayed item counts toward WQ's length limit from the time it
+   is posted, so that it is sure to fit when its time comes.  May
+   be called from an interrupt handler. */
+bool
+work_post_delayed (struct workqueue *wq, struct work *w, int64_t ticks) 
+{
+  enum intr_level old_level;
+  bool ok;
+
+  ASSERT (wq != NULL);
+  ASSERT (w != NULL);
+
+  if (ticks <= 0)
+    return work_post (wq, w);
+
+  old_level = intr_disable ();
+  ok = w->state == WORK_IDLE && wq->len < wq->max_len;
+  if (ok) 
+    {
+      wq->len++;
+      w->state = WORK_DELAYED;
+      w->wq = wq;
+      timer_event_schedule (&w->timer, ticks);
+    }
+  intr_set_level (old_level);
+
+  return ok;
+}
+
+/* Cancels W if it is delayed or queued.  Returns true if W was
+   cancelled, false if it was not delayed or queued.  If W is
+   currently running, it continues to run; use workqueue_flush()
+   to wait for it to finish.  May be called from an interrupt
+   handler. */
+bool
+work_cancel (struct work *w) 
+{
+  enum intr_level old_level;
+  bool cancelled = true;
+
+  ASSERT (w != NULL);
+
+  old_level = intr_disable ();
+  switch (w->state) 
+    {
+    case WORK_IDLE:
+      cancelled = false;
+      break;
+
+    case WORK_DELAYED:
+      timer_event_cancel (&w->timer);
+      break;
+
+    case WORK_QUEUED:
+      list_remove (&w->elem);
+
+      /* Take back the wakeup posted for W.  If a worker has
+         already consumed it, the worker will find the queue
+         empty and go back to waiting. */
+      sema_try_down (&w->wq->items);
+      wake_flushers (w->wq);
+      break;
+    }
+  if (cancelled) 
+    {
+      w->wq->len--;
+      w->state = WORK_IDLE;
+      w->wq = NULL;
+    }
+  intr_set_level (old_level);
+
+  return cancelled;
+}
+
+/* Worker thread body.  Runs the work items queued on WQ_, a
+   struct workqueue, one at a time, forever. */
+static void
+worker (void *wq_) 
+{
+  struct workqueue *wq = wq_;
+
+  for (;;) 
+    {
+      enum intr_level old_level;
+      struct work *w;
+      work_func *func;
+      void *aux;
+
+      sema_down (&wq->items);
+
+      old_level = intr_disable ();
+      if (list_empty (&wq->queue)) 
+        {
+          intr_set_level (old_level);
+          continue;
+        }
+      w = list_entry (list_pop_front (&wq->queue), struct work, elem);
+      func = w->func;
+      aux = w->aux;
+      w->state = WORK_IDLE;
+      w->wq = NULL;
+      wq->len--;
+      wq->busy++;
+      intr_set_level (old_level);
+
+      /* W must not be touched from here on: FUNC may post it
+         again or free it. */
+      func (aux);
+
+      old_level = intr_disable ();
+      wq->busy--;
+      wake_flushers (wq);
+      intr_set_level (old_level);
+    }
+}
+
+/* Timer event function for delayed work item W_, a struct
+   work.  Called from the timer interrupt handler. */
+static void
+delayed_expire (void *w_) 
+{
+  struct work *w = w_;
+
+  ASSERT (w->state == WORK_DELAYED);
+  enqueue (w->wq, w);
+}
+
+/* Adds W to the back of WQ's queue and wakes a worker for it.
+   W must already be counted in WQ's length.  Interrupts must be
+   off. */
+static void
+enqueue (struct workqueue *wq, struct work *w) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  w->state = WORK_QUEUED;
+  w->wq = wq;
+  list_push_back (&wq->queue, &w->elem);
+  sema_up (&wq->items);
+}
+
+/* Wakes every thread in workqueue_flush() for WQ, if WQ has no
+   queued or running work.  Interrupts must be off. */
+static void
+wake_flushers (struct workqueue *wq) 
+{
+  ASSERT (intr_get_level () == INTR_OFF);
+
+  if (!list_empty (&wq->queue) || wq->busy > 0)
+    return;
+  while (!list_empty (&wq->flushers)) 
+    {
+      struct flusher *f = list_entry (list_pop_front (&wq->flushers),
+                                      struct flusher, elem);
+      sema_up (&f->done);
+    }
+}
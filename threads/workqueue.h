@@ -0,0 +1,70 @@
+#ifndef THREADS_WORKQUEUE_H
+#define THREADS_WORKQUEUE_H
+
+#include <list.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "devices/timer.h"
+#include "threads/synch.h"
+
+/* A work queue: a fixed pool of kernel threads that run work
+   items posted to a queue, so that code wanting something done
+   asynchronously need not create and destroy a thread for it.
+
+   Work items can be posted by kernel threads or by interrupt
+   handlers.  They run in a worker thread, so, unlike interrupt
+   handlers, they may sleep.  Work posted to a queue with more
+   than one worker may run concurrently with other work from the
+   same queue, and may finish in any order. */
+
+/* Maximum number of worker threads per queue. */
+#define WORKQUEUE_MAX_WORKERS 8
+
+/* A function for a work item to run.  AUX is the work item's
+   auxiliary data. */
+typedef void work_func (void *aux);
+
+/* States of a work item. */
+enum work_state
+  {
+    WORK_IDLE,                  /* Not queued. */
+    WORK_DELAYED,               /* Waiting for its timer to expire. */
+    WORK_QUEUED                 /* On a queue, waiting for a worker. */
+  };
+
+/* A work item.  Embed one in the structure it operates on.  A
+   work item may be posted again, or freed, as soon as its
+   function starts running, including by the function itself. */
+struct work
+  {
+    struct list_elem elem;      /* Element in a workqueue's queue. */
+    enum work_state state;      /* Current state. */
+    work_func *func;            /* Function to run. */
+    void *aux;                  /* Auxiliary data for FUNC. */
+    struct workqueue *wq;       /* Queue while delayed or queued. */
+    struct timer_event timer;   /* Timer for delayed posting. */
+  };
+
+/* A work queue. */
+struct workqueue
+  {
+    const char *name;           /* Name, for worker thread names. */
+    struct list queue;          /* Queued work items. */
+    struct semaphore items;     /* Wakes a worker for each item. */
+    size_t len;                 /* # of queued and delayed items. */
+    size_t max_len;             /* Maximum value for len. */
+    int busy;                   /* # of workers running an item. */
+    struct list flushers;       /* Threads in workqueue_flush(). */
+  };
+
+bool workqueue_create (struct workqueue *, const char *name,
+                       int worker_cnt, size_t max_len, int priority);
+void workqueue_flush (struct workqueue *);
+
+void work_init (struct work *, work_func *, void *aux);
+bool work_post (struct workqueue *, struct work *);
+bool work_post_delayed (struct workqueue *, struct work *, int64_t ticks);
+bool work_cancel (struct work *);
+
+#endif /* threads/workqueue.h */
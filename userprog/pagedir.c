@@ -3,11 +3,68 @@
 #include <stddef.h>
 #include <string.h>
 #include "threads/init.h"
+#include "threads/interrupt.h"
 #include "threads/pte.h"
 #include "threads/palloc.h"
+#include "threads/thread.h"
+#include "threads/workqueue.h"
 
+/* Page directory recycling.
+
+   Tearing down a process's page directory means walking the
+   user half of it and freeing every page and page table, which
+   would otherwise delay the exiting process's parent.  Instead,
+   pagedir_destroy() queues the page directory on dead_pds, and
+   a background worker tears it down.
+
+   A torn-down page directory has an empty user half and the
+   same kernel half as init_page_dir, which never changes after
+   boot, so instead of being freed it is kept in pd_cache for
+   pagedir_create() to hand out again without copying.  When
+   the page allocator runs out of memory, it calls reclaim_pds(),
+   which finishes all pending teardowns and frees the cached page
+   directories.
+
+   Both arrays are accessed from the exiting thread and the
+   worker, so they are protected by turning off interrupts. */
+
+/* Maximum number of torn-down page directories to keep. */
+#define PAGEDIR_CACHE_MAX 8
+
+/* Maximum number of page directories awaiting teardown.  Their
+   pages are not free until they are torn down, so this bounds
+   the memory that can be tied up. */
+#define PAGEDIR_DEAD_MAX 16
+
+static uint32_t *pd_cache[PAGEDIR_CACHE_MAX];
+static size_t pd_cache_cnt;
+static uint32_t *dead_pds[PAGEDIR_DEAD_MAX];
+static size_t dead_pd_cnt;
+
+/* Worker that tears down dead_pds, if pagedir_init() succeeded. */
+static struct workqueue reclaim_wq;
+static struct work reclaim_work;
+static bool reclaim_running;
+
+static work_func reclaim_dead_pds;
+static palloc_reclaim_func reclaim_pds;
+static uint32_t *pop_cached_pd (void);
+static void teardown (uint32_t *pd);
 static uint32_t *active_pd (void);
 static void invalidate_pagedir (uint32_t *);
+static void invalidate_page (uint32_t *, const void *);
+
+/* Starts the worker that tears down page directories in the
+   background.  Until this is called, or if it fails,
+   pagedir_destroy() tears them down immediately. */
+void
+pagedir_init (void) 
+{
+  palloc_add_reclaimer (reclaim_pds, true);
+  work_init (&reclaim_work, reclaim_dead_pds, NULL);
+  reclaim_running = workqueue_create (&reclaim_wq, "pdreclaim", 1, 1,
+                                      PRI_DEFAULT);
+}
 
 /* Creates a new page directory that has mappings for kernel
    virtual addresses, but none for user virtual addresses.
@@ -16,23 +73,122 @@ static void invalidate_pagedir (uint32_t *);
 uint32_t *
 pagedir_create (void) 
 {
-  uint32_t *pd = palloc_get_page (0);
-  if (pd != NULL)
-    memcpy (pd, init_page_dir, PGSIZE);
+  uint32_t *pd = pop_cached_pd ();
+  if (pd == NULL) 
+    {
+      pd = palloc_get_page (0);
+      if (pd != NULL)
+        memcpy (pd, init_page_dir, PGSIZE);
+    }
   return pd;
 }
 
 /* Destroys page directory PD, freeing all the pages it
-   references. */
+   references.  PD must not be active.  The pages may be freed
+   later, by a background worker. */
 void
 pagedir_destroy (uint32_t *pd) 
 {
-  uint32_t *pde;
+  enum intr_level old_level;
+  bool queued = false;
 
   if (pd == NULL)
     return;
 
   ASSERT (pd != init_page_dir);
+  ASSERT (pd != active_pd ());
+
+  old_level = intr_disable ();
+  if (reclaim_running && dead_pd_cnt < PAGEDIR_DEAD_MAX) 
+    {
+      dead_pds[dead_pd_cnt++] = pd;
+      queued = true;
+    }
+  intr_set_level (old_level);
+
+  if (queued)
+    work_post (&reclaim_wq, &reclaim_work);
+  else
+    teardown (pd);
+}
+
+/* Frees the pages held by exited processes' page directories:
+   tears down those that pagedir_destroy() has queued, in the
+   calling thread, waits for the background worker to finish any
+   teardown it has started, and then frees the cached page
+   directories.  Returns true if there was anything to free.
+
+   Called by the page allocator when it runs out of memory.  May
+   sleep, which is safe because the background worker only frees
+   pages and so never calls it. */
+static bool
+reclaim_pds (void) 
+{
+  enum intr_level old_level;
+  uint32_t *pd;
+  bool freed;
+
+  old_level = intr_disable ();
+  freed = dead_pd_cnt > 0;
+  intr_set_level (old_level);
+
+  reclaim_dead_pds (NULL);
+  if (reclaim_running)
+    workqueue_flush (&reclaim_wq);
+  while ((pd = pop_cached_pd ()) != NULL) 
+    {
+      palloc_free_page (pd);
+      freed = true;
+    }
+  return freed;
+}
+
+/* Removes and returns a page directory from pd_cache, or
+   returns a null pointer if the cache is empty. */
+static uint32_t *
+pop_cached_pd (void) 
+{
+  enum intr_level old_level;
+  uint32_t *pd = NULL;
+
+  old_level = intr_disable ();
+  if (pd_cache_cnt > 0)
+    pd = pd_cache[--pd_cache_cnt];
+  intr_set_level (old_level);
+
+  return pd;
+}
+
+/* Tears down page directories from dead_pds until it is
+   empty. */
+static void
+reclaim_dead_pds (void *aux UNUSED) 
+{
+  for (;;) 
+    {
+      enum intr_level old_level;
+      uint32_t *pd = NULL;
+
+      old_level = intr_disable ();
+      if (dead_pd_cnt > 0)
+        pd = dead_pds[--dead_pd_cnt];
+      intr_set_level (old_level);
+
+      if (pd == NULL)
+        break;
+      teardown (pd);
+    }
+}
+
+/* Frees all the user pages and page tables in PD, then caches
+   PD for reuse by pagedir_create(), or frees it if the cache is
+   full. */
+static void
+teardown (uint32_t *pd) 
+{
+  enum intr_level old_level;
+  uint32_t *pde;
+
   for (pde = pd; pde < pd + pd_no (PHYS_BASE); pde++)
     if (*pde & PTE_P) 
       {
@@ -43,8 +199,19 @@ pagedir_destroy (uint32_t *pd)
           if (*pte & PTE_P) 
             palloc_free_page (pte_get_page (*pte));
         palloc_free_page (pt);
+        *pde = 0;
       }
-  palloc_free_page (pd);
+
+  old_level = intr_disable ();
+  if (pd_cache_cnt < PAGEDIR_CACHE_MAX) 
+    {
+      pd_cache[pd_cache_cnt++] = pd;
+      pd = NULL;
+    }
+  intr_set_level (old_level);
+
+  if (pd != NULL)
+    palloc_free_page (pd);
 }
 
 /* Returns the address of the page table entry for virtual
@@ -152,7 +319,7 @@ pagedir_clear_page (uint32_t *pd, void *upage)
   if (pte != NULL && (*pte & PTE_P) != 0)
     {
       *pte &= ~PTE_P;
-      invalidate_pagedir (pd);
+      invalidate_page (pd, upage);
     }
 }
 
@@ -180,7 +347,7 @@ pagedir_set_dirty (uint32_t *pd, const void *vpage, bool dirty)
       else 
         {
           *pte &= ~(uint32_t) PTE_D;
-          invalidate_pagedir (pd);
+          invalidate_page (pd, vpage);
         }
     }
 }
@@ -209,11 +376,67 @@ pagedir_set_accessed (uint32_t *pd, const void *vpage, bool accessed)
       else 
         {
           *pte &= ~(uint32_t) PTE_A; 
-          invalidate_pagedir (pd);
+          invalidate_page (pd, vpage);
         }
     }
 }
 
+/* Initializes FLUSH as an empty batch of TLB invalidations for
+   page directory PD.
+
+   To unmap a range of pages, call pagedir_clear_page_deferred()
+   for each page, then pagedir_flush() once.  Until then, the
+   TLB may still hold the old mappings, so the frames must not
+   be freed or reused before pagedir_flush() returns. */
+void
+pagedir_flush_init (struct pagedir_flush *flush, uint32_t *pd) 
+{
+  ASSERT (pd != NULL);
+
+  flush->pd = pd;
+  flush->page_cnt = 0;
+}
+
+/* Like pagedir_clear_page(), but queues the TLB invalidation
+   for UPAGE in FLUSH instead of doing it immediately. */
+void
+pagedir_clear_page_deferred (struct pagedir_flush *flush, void *upage) 
+{
+  uint32_t *pte;
+
+  ASSERT (pg_ofs (upage) == 0);
+  ASSERT (is_user_vaddr (upage));
+
+  pte = lookup_page (flush->pd, upage, false);
+  if (pte != NULL && (*pte & PTE_P) != 0)
+    {
+      *pte &= ~PTE_P;
+      if (flush->page_cnt < PAGEDIR_FLUSH_MAX)
+        flush->pages[flush->page_cnt] = upage;
+      flush->page_cnt++;
+    }
+}
+
+/* Invalidates the TLB entries for all the pages queued in FLUSH
+   and empties it.  Invalidating pages one at a time is cheaper
+   than a full flush for a few pages, but not for many, so if
+   more than PAGEDIR_FLUSH_MAX pages were queued this flushes the
+   whole TLB instead. */
+void
+pagedir_flush (struct pagedir_flush *flush) 
+{
+  if (flush->page_cnt > PAGEDIR_FLUSH_MAX)
+    invalidate_pagedir (flush->pd);
+  else 
+    {
+      size_t i;
+
+      for (i = 0; i < flush->page_cnt; i++)
+        invalidate_page (flush->pd, flush->pages[i]);
+    }
+  flush->page_cnt = 0;
+}
+
 /* Loads page directory PD into the CPU's page directory base
    register. */
 void
@@ -261,3 +484,14 @@ invalidate_pagedir (uint32_t *pd)
       pagedir_activate (pd);
     } 
 }
+
+/* Invalidates the TLB entry for virtual page VPAGE if PD is the
+   active page directory.  Unlike invalidate_pagedir(), this
+   leaves the rest of the TLB intact.  See [IA32-v2a]
+   "INVLPG--Invalidate TLB Entry". */
+static void
+invalidate_page (uint32_t *pd, const void *vpage) 
+{
+  if (active_pd () == pd)
+    asm volatile ("invlpg (%0)" : : "r" (vpage) : "memory");
+}
@@ -2,8 +2,24 @@
 #define USERPROG_PAGEDIR_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
+/* Most pages a pagedir_flush invalidates one by one.  If more
+   pages than this are queued, the whole TLB is flushed
+   instead. */
+#define PAGEDIR_FLUSH_MAX 32
+
+/* A batch of TLB invalidations for pages unmapped from one page
+   directory, for use when unmapping a range of pages. */
+struct pagedir_flush
+  {
+    uint32_t *pd;                       /* Page directory. */
+    size_t page_cnt;                    /* Number of pages queued. */
+    void *pages[PAGEDIR_FLUSH_MAX];     /* First PAGEDIR_FLUSH_MAX pages. */
+  };
+
+void pagedir_init (void);
 uint32_t *pagedir_create (void);
 void pagedir_destroy (uint32_t *pd);
 bool pagedir_set_page (uint32_t *pd, void *upage, void *kpage, bool rw);
@@ -15,4 +31,8 @@ bool pagedir_is_accessed (uint32_t *pd, const void *upage);
 void pagedir_set_accessed (uint32_t *pd, const void *upage, bool accessed);
 void pagedir_activate (uint32_t *pd);
 
+void pagedir_flush_init (struct pagedir_flush *, uint32_t *pd);
+void pagedir_clear_page_deferred (struct pagedir_flush *, void *upage);
+void pagedir_flush (struct pagedir_flush *);
+
 #endif /* userprog/pagedir.h */
@@ -8,6 +8,7 @@
 #include "userprog/gdt.h"
 #include "userprog/pagedir.h"
 #include "userprog/tss.h"
+#include "devices/clock.h"
 #include "filesys/directory.h"
 #include "filesys/file.h"
 #include "filesys/filesys.h"
@@ -20,6 +21,18 @@
 
 static thread_func start_process NO_RETURN;
 static bool load (const char *cmdline, void (**eip) (void), void **esp);
+static void add_time (long long *cnt, uint64_t *total_ns, uint64_t start_ns);
+
+/* Statistics for the kernel's part of a process's life: starting
+   it, in process_execute() and load(), and ending it, in
+   process_exit(). */
+static long long exec_cnt;      /* # of processes started. */
+static uint64_t exec_ns;        /* Nanoseconds spent starting them. */
+static long long exit_cnt;      /* # of processes exited. */
+static uint64_t exit_ns;        /* Nanoseconds spent exiting them. */
+
+/* -procstat: Print process statistics at shutdown? */
+bool process_procstat;
 
 /* Starts a new thread running a user program loaded from
    FILENAME.  The new thread may be scheduled (and may even exit)
@@ -28,6 +41,7 @@ static bool load (const char *cmdline, void (**eip) (void), void **esp);
 tid_t
 process_execute (const char *file_name) 
 {
+  uint64_t start = clock_ns ();
   char *fn_copy;
   tid_t tid;
 
@@ -42,6 +56,8 @@ process_execute (const char *file_name)
   tid = thread_create (file_name, PRI_DEFAULT, start_process, fn_copy);
   if (tid == TID_ERROR)
     palloc_free_page (fn_copy); 
+  else
+    add_time (&exec_cnt, &exec_ns, start);
   return tid;
 }
 
@@ -52,6 +68,7 @@ start_process (void *file_name_)
 {
   char *file_name = file_name_;
   struct intr_frame if_;
+  uint64_t start = clock_ns ();
   bool success;
 
   /* Initialize interrupt frame and load executable. */
@@ -60,6 +77,7 @@ start_process (void *file_name_)
   if_.cs = SEL_UCSEG;
   if_.eflags = FLAG_IF | FLAG_MBS;
   success = load (file_name, &if_.eip, &if_.esp);
+  add_time (NULL, &exec_ns, start);
 
   /* If load failed, quit. */
   palloc_free_page (file_name);
@@ -96,6 +114,7 @@ void
 process_exit (void)
 {
   struct thread *cur = thread_current ();
+  uint64_t start = clock_ns ();
   uint32_t *pd;
 
   /* Destroy the current process's page directory and switch back
@@ -113,9 +132,40 @@ process_exit (void)
       cur->pagedir = NULL;
       pagedir_activate (NULL);
       pagedir_destroy (pd);
+      add_time (&exit_cnt, &exit_ns, start);
     }
 }
 
+/* Prints process statistics, if requested with -procstat: how
+   many processes were started and exited, and the average time
+   the kernel took for each. */
+void
+process_print_stats (void) 
+{
+  if (!process_procstat)
+    return;
+
+  printf ("Process: %lld execs, %"PRIu64" ns each; "
+          "%lld exits, %"PRIu64" ns each\n",
+          exec_cnt, exec_cnt > 0 ? exec_ns / exec_cnt : 0,
+          exit_cnt, exit_cnt > 0 ? exit_ns / exit_cnt : 0);
+}
+
+/* Adds the nanoseconds since START_NS to *TOTAL_NS and, if CNT
+   is nonnull, increments *CNT. */
+static void
+add_time (long long *cnt, uint64_t *total_ns, uint64_t start_ns) 
+{
+  uint64_t elapsed = clock_ns () - start_ns;
+  enum intr_level old_level;
+
+  old_level = intr_disable ();
+  if (cnt != NULL)
+    (*cnt)++;
+  *total_ns += elapsed;
+  intr_set_level (old_level);
+}
+
 /* Sets up the CPU for running user code in the current
    thread.
    This function is called on every context switch. */
@@ -7,5 +7,9 @@ tid_t process_execute (const char *file_name);
 int process_wait (tid_t);
 void process_exit (void);
 void process_activate (void);
+void process_print_stats (void);
+
+/* -procstat: Print process statistics at shutdown? */
+extern bool process_procstat;
 
 #endif /* userprog/process.h */